@@ -0,0 +1,287 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Minicurl
+// Copyright 2019 Jean Diogo (aka Jango) <jeandiogo@gmail.com>
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// bench.cpp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// needs a local server answering both http/1.1 and cleartext http/2 (h2c) on the same address, and on a unix domain socket, e.g.
+//
+//	nghttpd --no-tls -d www 8081
+//	nghttpx --frontend='127.0.0.1,8080;no-tls' --frontend='unix:/tmp/minicurl.sock;no-tls' --backend='127.0.0.1,8081;;proto=h2'
+//
+// serving www/small.bin (16 KB), www/large.bin (1 MB) and, for the body size sweep, files named after their size in bytes
+//
+//	for n in 10 12 14 16 18 20 22 24 26 28 30; do head -c $((1 << n)) /dev/zero > www/$((1 << n)).bin; done
+//
+// nghttpd reads and discards the body of a PUT before answering with the file, which makes small.bin the upload sink
+//
+// libcurl 7.88 cannot reuse an h2c connection opened with prior knowledge, use an earlier or later release
+//
+// the library logs every transfer to stdout, so the results go to stderr and bench_output.txt
+//
+//	./bench.out [origin] [requests] [socket] [largest body in bytes] > /dev/null
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "minicurl.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <memory_resource>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+static std::ostringstream report;
+
+static void print(std::string const & label, std::size_t ok, std::size_t requests, double seconds)
+{
+	report << label << ": " << ok << "/" << requests << " ok, " << seconds << " s, " << static_cast<std::size_t>(requests / seconds) << " requests/s\n";
+}
+
+// every request on the calling thread, each waiting for the previous one
+static void sequential(std::string const & label, std::string const & url, std::size_t requests)
+{
+	std::size_t ok = 0;
+	auto start = std::chrono::steady_clock::now();
+	for(std::size_t i = 0; i < requests; ++i)
+	{
+		ok += minicurl::get_response(url).status == 200;
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	print(label, ok, requests, elapsed.count());
+}
+
+// every request handed to the event thread at once, at most max_in_flight of them running together
+static void fan_out(std::string const & label, std::string const & url, std::size_t requests)
+{
+	std::vector<std::string> urls(requests, url);
+	std::size_t ok = 0;
+	auto start = std::chrono::steady_clock::now();
+	for(minicurl::batch_item const & item : minicurl::get_many(urls))
+	{
+		ok += item.ok() && item.response.status == 200;
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	print(label, ok, requests, elapsed.count());
+}
+
+// the same number of blocking requests split across threads, each running its share back to back
+static void scaling(std::string const & url, std::size_t requests, std::size_t threads)
+{
+	std::vector<std::size_t> ok(threads, 0);
+	std::vector<std::thread> workers;
+	auto start = std::chrono::steady_clock::now();
+	for(std::size_t t = 0; t < threads; ++t)
+	{
+		workers.emplace_back([&, t]
+		{
+			for(std::size_t i = t; i < requests; i += threads)
+			{
+				ok[t] += minicurl::get_response(url).status == 200;
+			}
+		});
+	}
+	for(std::thread & worker : workers)
+	{
+		worker.join();
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	std::size_t total = 0;
+	for(std::size_t n : ok)
+	{
+		total += n;
+	}
+	print(std::to_string(threads) + (threads == 1 ? " thread" : " threads"), total, requests, elapsed.count());
+}
+
+// one request at a time, reporting the mean time per request and the body throughput
+static void transfer(std::string const & label, std::string const & url, std::size_t requests)
+{
+	std::size_t ok = 0;
+	std::size_t bytes = 0;
+	auto start = std::chrono::steady_clock::now();
+	for(std::size_t i = 0; i < requests; ++i)
+	{
+		minicurl::package response = minicurl::get_response(url);
+		ok += response.status == 200;
+		bytes += response.content.size;
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	report << label << ": " << ok << "/" << requests << " ok, " << elapsed.count() * 1e6 / requests << " us per request, " << bytes / elapsed.count() / 1e6 << " MB/s\n";
+}
+
+// the same resources over loopback tcp and through the server's unix domain socket
+static void local_transport(std::string const & origin, std::string const & socket, std::size_t requests)
+{
+	transfer("tcp, small.bin", origin + "/small.bin", requests);
+	transfer("unix socket, small.bin", "unix://" + socket + ":/small.bin", requests);
+	transfer("tcp, large.bin", origin + "/large.bin", requests / 10);
+	transfer("unix socket, large.bin", "unix://" + socket + ":/large.bin", requests / 10);
+}
+
+// the heap, counting the buffers handed out so a body's reallocations show up
+struct counting_resource : std::pmr::memory_resource
+{
+	std::size_t allocations = 0;
+	
+	void * do_allocate(std::size_t bytes, std::size_t alignment) override
+	{
+		++allocations;
+		return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+	}
+	
+	void do_deallocate(void * buffer, std::size_t bytes, std::size_t alignment) override
+	{
+		std::pmr::new_delete_resource()->deallocate(buffer, bytes, alignment);
+	}
+	
+	bool do_is_equal(std::pmr::memory_resource const & other) const noexcept override
+	{
+		return this == &other;
+	}
+};
+
+// bodies from 1 KB up to largest, quadrupling, each fetched often enough to move about 256 MB
+static void body_sizes(std::string const & origin, std::size_t requests, std::size_t largest)
+{
+	for(std::size_t body = 1024; body <= largest; body *= 4)
+	{
+		std::size_t count = std::max<std::size_t>(3, std::min<std::size_t>(requests, (std::size_t(256) << 20) / body));
+		std::string url = origin + "/" + std::to_string(body) + ".bin";
+		counting_resource counter;
+		std::size_t ok = 0;
+		std::size_t bytes = 0;
+		auto start = std::chrono::steady_clock::now();
+		for(std::size_t i = 0; i < count; ++i)
+		{
+			minicurl::package response = minicurl::get_response(url, {}, &counter);
+			ok += response.status == 200 && response.content.size == body;
+			bytes += response.content.size;
+		}
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		report << body << " bytes: " << ok << "/" << count << " ok, " << double(counter.allocations) / count << " allocations per response, " << bytes / elapsed.count() / 1e6 << " MB/s\n";
+	}
+}
+
+// files from 64 KB up to largest, quadrupling, each uploaded often enough to move about 256 MB
+static void uploads(std::string const & origin, std::size_t requests, std::size_t largest)
+{
+	std::string const filename = "bench_upload.bin";
+	std::string const block(std::size_t(1) << 20, '\0');
+	for(std::size_t body = std::size_t(64) << 10; body <= largest; body *= 4)
+	{
+		{
+			std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+			for(std::size_t written = 0; written < body; written += block.size())
+			{
+				file.write(block.data(), static_cast<std::streamsize>(std::min(block.size(), body - written)));
+			}
+		}
+		std::size_t count = std::max<std::size_t>(3, std::min<std::size_t>(requests, (std::size_t(256) << 20) / body));
+		std::size_t ok = 0;
+		auto start = std::chrono::steady_clock::now();
+		for(std::size_t i = 0; i < count; ++i)
+		{
+			ok += minicurl::upload(origin + "/small.bin", filename).size() == 16384;
+		}
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		report << body << " bytes: " << ok << "/" << count << " ok, " << elapsed.count() * 1e3 / count << " ms per upload, " << body * count / elapsed.count() / 1e6 << " MB/s\n";
+	}
+	std::remove(filename.c_str());
+}
+
+// build responses the way the transfer callbacks do, counting the buffers each one takes beyond its inline storage
+static void small_responses()
+{
+	std::string header = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: 0\r\nDate: Sat, 17 Oct 2026 20:20:47 GMT\r\nCache-Control: no-cache\r\nConnection: keep-alive\r\n\r\n";
+	std::size_t const responses = 100000;
+	report << "package is " << sizeof(minicurl::package) << " bytes, " << minicurl::chunk::inline_capacity << " of them inline per chunk\n";
+	for(std::size_t body : {100, 400, 1000, 2000, 4000})
+	{
+		std::string data(body, 'x');
+		minicurl::buffer_stats before = minicurl::get_buffer_stats();
+		auto start = std::chrono::steady_clock::now();
+		for(std::size_t i = 0; i < responses; ++i)
+		{
+			minicurl::package response;
+			response.header.append(header.data(), header.size());
+			response.content.reserve(body);
+			response.content.append(data.data(), data.size());
+		}
+		std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+		minicurl::buffer_stats after = minicurl::get_buffer_stats();
+		report << body << " byte body: " << double(after.hits + after.misses - before.hits - before.misses) / responses << " pooled buffers, " << double(after.misses - before.misses) / responses << " allocations, " << elapsed.count() / responses << " ns per response\n";
+	}
+}
+
+int main(int argc, char ** argv)
+{
+	std::string origin = argc > 1 ? argv[1] : "http://127.0.0.1:8080";
+	std::size_t requests = argc > 2 ? std::stoul(argv[2]) : 1000;
+	std::string socket = argc > 3 ? argv[3] : "/tmp/minicurl.sock";
+	std::size_t largest = argc > 4 ? std::stoull(argv[4]) : std::size_t(1) << 30;
+	std::string url = origin + "/small.bin";
+	
+	minicurl::config options;
+	options.timeout_ms = 10000;
+	minicurl::init(options);
+	
+	report << "Same-host fan-out against " << url << ":\n\n";
+	
+	minicurl::set_multiplexing(false);
+	sequential("http/1.1, one at a time", url, requests);
+	fan_out("http/1.1, get_many", url, requests);
+	
+	minicurl::set_multiplexing(true, true);
+	sequential("http/2 multiplexed, one at a time", url, requests);
+	fan_out("http/2 multiplexed, get_many", url, requests);
+	
+	report << "\nBlocking requests from several threads over http/1.1:\n\n";
+	minicurl::set_multiplexing(false);
+	for(std::size_t threads = 1; threads <= 64; threads *= 2)
+	{
+		scaling(url, requests * 4, threads);
+	}
+	
+	report << "\nLoopback tcp against a unix domain socket, one request at a time over http/1.1:\n\n";
+	local_transport(origin, socket, requests);
+	
+	report << "\nBody sizes, one request at a time over http/1.1, buffers from a counting memory resource:\n\n";
+	body_sizes(origin, requests, largest);
+	
+	report << "\nUploads from a file, one at a time over http/1.1:\n\n";
+	uploads(origin, requests, largest);
+	
+	report << "\nBuffers per small response, without the network:\n\n";
+	small_responses();
+	
+	minicurl::pool_stats pool = minicurl::get_pool_stats();
+	report << "\nHandle pool (reused / missed / idle): " << pool.reused << " / " << pool.missed << " / " << pool.idle << "\n";
+	
+	std::cerr << report.str();
+	std::ofstream("bench_output.txt") << report.str();
+	
+	return 0;
+}
@@ -27,546 +27,3256 @@
 #ifndef WINDOWS
 
 #include <cstring>
+#include <cstdint>
+#include <limits>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <cerrno>
+#include <cstdlib>
 #include <curl/curl.h>
 #include <iostream>
+#include <sstream>
 #include <fstream>
+#include <algorithm>
+#include <cctype>
 #include <string>
+#include <string_view>
 #include <vector>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <memory_resource>
+#include <functional>
+#include <exception>
+#include <future>
+#include <thread>
+#include <chrono>
+#include <unordered_set>
+#include <map>
+#include <condition_variable>
 
 #else
 
 #include <cstring>
+#include <cstdint>
+#include <limits>
 #include <curl/curl.h>
 #include <iostream>
 #include <sstream>
 #include <fstream>
 #include <algorithm> 
-#include <functional> 
 #include <cctype>
 #include <locale>
 #include <string>
+#include <string_view>
 #include <vector>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <memory_resource>
+#include <functional>
+#include <future>
+#include <thread>
+#include <chrono>
+#include <unordered_set>
+#include <map>
+#include <condition_variable>
 
 #endif
 
 class minicurl
 {
+	// after construction the guard of the function-local static is a single acquire load, no lock is taken
 	static minicurl& get_singleton()
 	{
-		static minicurl singleton;
+		static minicurl singleton(initial_settings());
 		return singleton;
 	}
 	
-	struct chunk
+	public:
+	
+	// replacements for the allocation functions libcurl uses internally, all five must be set to take effect
+	struct allocator
 	{
-		std::size_t size;
-		char * data;
-
-		friend void swap(chunk & x, chunk & y)
+		curl_malloc_callback malloc_function = nullptr;
+		curl_free_callback free_function = nullptr;
+		curl_realloc_callback realloc_function = nullptr;
+		curl_strdup_callback strdup_function = nullptr;
+		curl_calloc_callback calloc_function = nullptr;
+		
+		bool complete() const
 		{
-			using std::swap;
-			swap(x.size, y.size);
-			swap(x.data, y.data);
+			return malloc_function && free_function && realloc_function && strdup_function && calloc_function;
 		}
-
-		chunk(std::size_t s = 0) : size(s)
+	};
+	
+	// settings applied to the handles minicurl creates, a zero connection limit means unlimited
+	struct config
+	{
+		long timeout_ms = 1000;
+		bool follow_location = true;
+		std::string user_agent = "libcurl-agent/1.0";
+		bool multiplex = false;
+		bool prior_knowledge = false;
+		
+		// caps of the event thread's multi handle, so they bound async calls, get_many and segmented downloads only
+		// blocking calls run one connection per calling thread, each kept by its pooled handle
+		long max_host_connections = 0;
+		long max_total_connections = 0;
+		
+		// idle connections each handle keeps open
+		long max_connects = 0;
+		bool tcp_keepalive = false;
+		long keepalive_idle_seconds = 60;
+		long keepalive_interval_seconds = 60;
+		long max_idle_seconds = 0;
+		
+		// upper bound of the memory idle response buffers may keep in the buffer pool
+		std::size_t max_pooled_bytes = std::size_t(64) << 20;
+		
+		// response bodies past this many bytes continue in an unlinked temporary file, zero keeps them in memory
+		std::size_t memory_limit = 0;
+		
+		// downloads go to disk through a buffer this large, zero writes every block as it arrives
+		std::size_t write_buffer_bytes = std::size_t(1) << 20;
+		
+		// flush downloads to the device and checkpoint their progress after this many bytes, zero leaves it to the system
+		std::size_t sync_bytes = std::size_t(64) << 20;
+		
+		// attempts a download makes in a row without receiving anything before giving up
+		std::size_t max_retries = 3;
+		
+		// flush a finished download to the device before it replaces the target, so a crash never leaves a torn file
+		bool sync_on_close = true;
+		
+		// requests to these hosts go through the mapped unix domain socket instead of tcp
+		std::map<std::string, std::string> unix_sockets;
+		
+		// only honored by init before the first request, libcurl cannot switch allocators once initialized
+		allocator library_allocator;
+	};
+	
+	private:
+	
+	// settings given to init before the singleton exists
+	static config & initial_settings()
+	{
+		static config options;
+		return options;
+	}
+	
+	// prefixes every block with its size so frees can be accounted, the counters outlive the singleton
+	struct counting
+	{
+		static constexpr std::size_t prefix = alignof(std::max_align_t);
+		
+		static std::atomic<std::size_t> & allocations()
 		{
-			data = (char *)malloc(sizeof(char) * (size + 1));
-			if (data)
+			static std::atomic<std::size_t> value{0};
+			return value;
+		}
+		
+		static std::atomic<std::size_t> & allocated()
+		{
+			static std::atomic<std::size_t> value{0};
+			return value;
+		}
+		
+		static std::atomic<std::size_t> & live()
+		{
+			static std::atomic<std::size_t> value{0};
+			return value;
+		}
+		
+		// bytes allocated by libcurl on the calling thread, sampled around blocking transfers
+		static std::size_t & thread_allocated()
+		{
+			static thread_local std::size_t value = 0;
+			return value;
+		}
+		
+		static void note(std::size_t size)
+		{
+			++allocations();
+			allocated() += size;
+			live() += size;
+			thread_allocated() += size;
+		}
+		
+		static void * allocate(std::size_t size)
+		{
+			char * block = (char *)malloc(size + prefix);
+			if(!block)
 			{
-				data[size] = '\0';
+				return nullptr;
 			}
-			else
+			*(std::size_t *)block = size;
+			note(size);
+			return block + prefix;
+		}
+		
+		static void release(void * data)
+		{
+			if(data)
 			{
-				size = 0;
+				char * block = (char *)data - prefix;
+				live() -= *(std::size_t *)block;
+				free(block);
 			}
 		}
-
-		chunk(chunk const & other) : size(other.size)
+		
+		static void * resize(void * data, std::size_t size)
 		{
-			data = (char *)malloc(sizeof(char) * (size + 1));
-			if (data)
+			if(!data)
 			{
-				memcpy(data, other.data, size);
-				data[size] = '\0';
+				return allocate(size);
 			}
-			else
+			char * block = (char *)data - prefix;
+			std::size_t old = *(std::size_t *)block;
+			char * aux = (char *)realloc(block, size + prefix);
+			if(!aux)
 			{
-				size = 0;
+				return nullptr;
 			}
+			*(std::size_t *)aux = size;
+			live() -= old;
+			note(size);
+			return aux + prefix;
 		}
-
-		chunk(chunk && other) : chunk()
+		
+		static char * duplicate(char const * text)
 		{
-			swap(*this, other);
+			std::size_t size = strlen(text) + 1;
+			char * copy = (char *)allocate(size);
+			if(copy)
+			{
+				memcpy(copy, text, size);
+			}
+			return copy;
 		}
-
-		chunk & operator=(chunk other)
+		
+		static void * zeroed(std::size_t count, std::size_t size)
 		{
-			swap(*this, other);
-			return *this;
+			if(size && count > static_cast<std::size_t>(-1) / size)
+			{
+				return nullptr;
+			}
+			void * data = allocate(count * size);
+			if(data)
+			{
+				memset(data, 0, count * size);
+			}
+			return data;
 		}
-
-		~chunk()
+	};
+	
+	struct handle_pool
+	{
+		struct idle_handle
 		{
-			if (data)
+			CURL * curl;
+			std::chrono::steady_clock::time_point since;
+		};
+		
+		std::mutex mutex;
+		std::vector<idle_handle> idle;
+		std::atomic<std::size_t> reused{0};
+		std::atomic<std::size_t> missed{0};
+		std::atomic<std::size_t> evicted{0};
+		
+		CURL * checkout(long max_idle_seconds)
+		{
+			std::vector<idle_handle> expired;
+			CURL * curl = nullptr;
 			{
-				free(data);
-				data = nullptr;
+				std::lock_guard<std::mutex> lock(mutex);
+				if(max_idle_seconds > 0)
+				{
+					// handles are checked in at the back, so the ones idle for too long are at the front
+					auto limit = std::chrono::steady_clock::now() - std::chrono::seconds(max_idle_seconds);
+					auto first = std::find_if(idle.begin(), idle.end(), [limit](idle_handle const & h) { return h.since >= limit; });
+					expired.assign(idle.begin(), first);
+					idle.erase(idle.begin(), first);
+				}
+				if(idle.size())
+				{
+					curl = idle.back().curl;
+					idle.pop_back();
+				}
 			}
-			size = 0;
+			for(idle_handle & h : expired)
+			{
+				curl_easy_cleanup(h.curl);
+				++evicted;
+			}
+			if(curl)
+			{
+				++reused;
+				return curl;
+			}
+			++missed;
+			return curl_easy_init();
 		}
-
-		void save(std::iostream& file)
+		
+		void checkin(CURL * curl)
 		{
-			// persist data as is, without the null terminator
-			file.write(data, size);
-			file.flush();
+			if(curl)
+			{
+				// forget the options of the last request but keep its live connections and caches
+				curl_easy_reset(curl);
+				std::lock_guard<std::mutex> lock(mutex);
+				idle.push_back({curl, std::chrono::steady_clock::now()});
+			}
 		}
 		
-		std::string to_string() const
+		void clear()
 		{
-			std::string content = "";
-			if(size && data)
+			std::lock_guard<std::mutex> lock(mutex);
+			for(idle_handle & h : idle)
 			{
-				content = std::string(data, size);
+				curl_easy_cleanup(h.curl);
 			}
-			return content;
+			idle.clear();
 		}
 	};
 	
-	struct package
+	handle_pool handles;
+	
+	struct share
 	{
-		std::size_t status = 0;
-		chunk header;
-		chunk content;
+		CURLSH * handle = nullptr;
 		
-		// response not found
-#pragma region Error Handling
-		bool isValid() const
-		{
-			return !isEmpty() && !hasErrors();
-		}
+		// libcurl only ever asks for exclusive access, so a reader-writer lock would buy nothing
+		std::mutex locks[CURL_LOCK_DATA_LAST];
+		std::atomic<std::size_t> dns_hits{0};
+		std::atomic<std::size_t> tls_resumptions{0};
+		std::atomic<std::size_t> connections_reused{0};
 		
-		bool hasErrors() const
-		{
-			std::string response = content.to_string();
-			return isNotFound(response) || isNotAuthorized(response);
-		}
-
-		bool isNotFound() const
+		static void lock_function(CURL *, curl_lock_data data, curl_lock_access, void * userptr)
 		{
-			return isNotFound(content.to_string());
+			share * self = (share *) userptr;
+			if(data < CURL_LOCK_DATA_LAST)
+			{
+				self->locks[data].lock();
+			}
 		}
-
-		bool isEmpty() const
+		
+		static void unlock_function(CURL *, curl_lock_data data, void * userptr)
 		{
-			return content.size == 0;
+			share * self = (share *) userptr;
+			if(data < CURL_LOCK_DATA_LAST)
+			{
+				self->locks[data].unlock();
+			}
 		}
-
-		static bool isNotFound(const std::string& response)
+		
+		void init()
 		{
-			return response.find("<title>404 ") != -1;
+			handle = curl_share_init();
+			if(handle)
+			{
+				curl_share_setopt(handle, CURLSHOPT_LOCKFUNC, lock_function);
+				curl_share_setopt(handle, CURLSHOPT_UNLOCKFUNC, unlock_function);
+				curl_share_setopt(handle, CURLSHOPT_USERDATA, this);
+				curl_share_setopt(handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+				curl_share_setopt(handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+				
+				// not the connection cache, libcurl does not support using shared connections from concurrent threads
+				// each pooled handle keeps its own connections, and the event thread's multi handle those of async transfers
+			}
 		}
-
-		bool isNotAuthorized() const
+		
+		void cleanup()
 		{
-			return isNotAuthorized(content.to_string());
+			if(handle)
+			{
+				curl_share_cleanup(handle);
+				handle = nullptr;
+			}
 		}
-
-		// response not authorized
-		static bool isNotAuthorized(const std::string& response)
+	};
+	
+	share shared;
+	
+	// an immutable value read on every request and replaced wholesale by the rare update
+	template<typename T>
+	struct snapshot
+	{
+		std::shared_ptr<const T> value = std::make_shared<const T>();
+		std::atomic<std::size_t> generation{0};
+		
+		// atomic_load of a shared_ptr takes a lock, so each thread keeps the last snapshot it saw until the generation moves
+		std::shared_ptr<const T> load() const
 		{
-			return response.find("<title>403 ") != -1;
+			struct cached
+			{
+				std::size_t generation = static_cast<std::size_t>(-1);
+				std::shared_ptr<const T> value;
+			};
+			static thread_local cached last;
+			std::size_t now = generation.load(std::memory_order_acquire);
+			if(last.generation != now)
+			{
+				last.value = std::atomic_load(&value);
+				last.generation = now;
+			}
+			return last.value;
 		}
-#pragma endregion
-
-		void save(std::iostream& file)
+		
+		void store(std::shared_ptr<const T> next)
 		{
-			content.save(file);
+			std::atomic_store(&value, std::move(next));
+			generation.fetch_add(1, std::memory_order_release);
 		}
+	};
+	
+	// requests read an immutable snapshot, configure swaps in a new one
+	snapshot<config> settings;
+	
+	std::shared_ptr<const config> current() const
+	{
+		return settings.load();
+	}
+	
+	// callers load the settings once per request and hand the same snapshot to prepare
+	CURL * checkout(config const & options)
+	{
+		return handles.checkout(options.max_idle_seconds);
+	}
+	
+	// static resolve and connect-to entries, keyed by "host:port"
+	struct route_table
+	{
+		std::map<std::string, std::string> resolve;
+		std::map<std::string, std::string> connect_to;
 		
-		friend void swap(package & x, package & y)
+		// pins stay in the shared dns cache until a request removes them with a "-host:port" entry
+		std::vector<std::string> removed;
+		mutable std::atomic<bool> flushed{false};
+		
+		curl_slist * resolve_list = nullptr;
+		curl_slist * flush_list = nullptr;
+		curl_slist * connect_to_list = nullptr;
+		
+		route_table()
 		{
-			using std::swap;
-			swap(x.status, y.status);
-			swap(x.header, y.header);
-			swap(x.content, y.content);
 		}
 		
-		package()
+		route_table(route_table const & other) : resolve(other.resolve), connect_to(other.connect_to), removed(other.removed)
 		{
 		}
 		
-		package(std::size_t s, chunk const & h, chunk const & c) : status(s), header(h), content(c)
+		route_table & operator=(route_table const &) = delete;
+		
+		~route_table()
 		{
+			curl_slist_free_all(resolve_list);
+			curl_slist_free_all(flush_list);
+			curl_slist_free_all(connect_to_list);
 		}
 		
-		package(package const & other) : status(other.status), header(other.header), content(other.content)
+		void build()
 		{
+			for(auto const & entry : resolve)
+			{
+				resolve_list = curl_slist_append(resolve_list, (entry.first + ":" + entry.second).c_str());
+				flush_list = curl_slist_append(flush_list, (entry.first + ":" + entry.second).c_str());
+			}
+			for(std::string const & key : removed)
+			{
+				flush_list = curl_slist_append(flush_list, ("-" + key).c_str());
+			}
+			for(auto const & entry : connect_to)
+			{
+				connect_to_list = curl_slist_append(connect_to_list, (entry.first + ":" + entry.second).c_str());
+			}
 		}
 		
-		package(package && other) : package()
+		// the first request after an update also flushes the removed pins
+		curl_slist * resolve_entries() const
 		{
-			swap(*this, other);
+			if(removed.size() && !flushed.exchange(true))
+			{
+				return flush_list;
+			}
+			return resolve_list;
 		}
+	};
+	
+	// requests only load the current snapshot, updates copy it under the writer lock and swap it in
+	snapshot<route_table> routes;
+	std::mutex routes_mutex;
+	
+	template<typename Update>
+	void update_routes(Update update)
+	{
+		std::lock_guard<std::mutex> lock(routes_mutex);
+		auto table = std::make_shared<route_table>(*routes.load());
+		update(*table);
+		table->build();
+		routes.store(table);
+	}
+	
+	// everything a prepared transfer refers to and that must outlive it
+	struct attachments
+	{
+		curl_slist * header_list = nullptr;
+		std::shared_ptr<const route_table> routes;
 		
-		package& operator=(package other)
+		attachments()
 		{
-			swap(*this, other);
-			return *this;
 		}
 		
-		~package()
+		attachments(attachments const &) = delete;
+		attachments & operator=(attachments const &) = delete;
+		
+		~attachments()
 		{
-			status = 0;
+			if(header_list)
+			{
+				curl_slist_free_all(header_list);
+			}
 		}
 	};
 	
-	static std::vector<std::string> split(std::string const & data, std::string const & delimiters = " \n\t")
+	// chunk storage comes in power-of-two size classes kept on per-thread free lists, larger buffers go straight to malloc
+	struct buffer_pool
 	{
-		std::vector<std::string> tokens;
-		size_t const size = data.size();
-		if(size)
+		static constexpr std::size_t smallest = 256;
+		static constexpr std::size_t classes = 15;
+		
+		// buffers of one class a thread keeps for itself before handing them to the shared lists
+		static constexpr std::size_t local_limit = 16;
+		
+		struct node
 		{
-			std::size_t current = 0;
-			for(std::size_t i = 0; i < size; ++i)
+			node * next;
+		};
+		
+		struct shelf
+		{
+			node * heads[classes] = {};
+			std::size_t counts[classes] = {};
+			
+			node * pop(std::size_t index)
 			{
-				if(strchr(delimiters.c_str(), data[i]))
+				node * n = heads[index];
+				if(n)
 				{
-					tokens.emplace_back(&(data[current]), (i - current));
-					current = i + 1;
+					heads[index] = n->next;
+					--counts[index];
 				}
+				return n;
 			}
-			tokens.emplace_back(&(data[current]), (size - current));
-		}
-		return tokens;
-	}
-
-	static size_t debug_function(CURL * Handle, curl_infotype DebugInfoType, char * DebugInfo, size_t DebugInfoSize, void* UserData)
-	{
-		switch (DebugInfoType)
+			
+			void push(std::size_t index, node * n)
+			{
+				n->next = heads[index];
+				heads[index] = n;
+				++counts[index];
+			}
+		};
+		
+		inline static thread_local bool retired = false;
+		
+		struct thread_shelf : shelf
 		{
-		case CURLINFO_TEXT:
+			~thread_shelf()
+			{
+				for(std::size_t index = 0; index < classes; ++index)
+				{
+					while(node * n = pop(index))
+					{
+						instance().retained -= block_size(index);
+						free(n);
+					}
+				}
+				retired = true;
+			}
+		};
+		
+		std::mutex mutex;
+		shelf shared;
+		std::atomic<std::size_t> limit{std::size_t(64) << 20};
+		std::atomic<std::size_t> retained{0};
+		std::atomic<std::size_t> hits{0};
+		std::atomic<std::size_t> misses{0};
+		
+		// not owned by the singleton because packages may outlive it
+		static buffer_pool & instance()
 		{
-			// in this case DebugInfo is a C string (see http://curl.haxx.se/libcurl/c/debug.html)
-			// C string is not null terminated:  https://curl.haxx.se/libcurl/c/CURLOPT_DEBUGFUNCTION.html
-
-			// Truncate at 1023 characters. This is just an arbitrary number based on a buffer size seen in
-			// the libcurl code.
-			DebugInfoSize = min(DebugInfoSize, (size_t)1023);
-
-			// Calculate the actual length of the string due to incorrect use of snprintf() in lib/vtls/openssl.c.
-			char* FoundNulPtr = (char*)memchr(DebugInfo, 0, DebugInfoSize);
-			int CalculatedSize = FoundNulPtr != nullptr ? FoundNulPtr - DebugInfo : DebugInfoSize;
-
-			std::string DebugText(DebugInfo, CalculatedSize);
-
-			//findAndReplaceAll(DebugText, "\n", "");
-			//findAndReplaceAll(DebugText, "\r", "");
-
-			std::cout << DebugText << "\n";
+			static buffer_pool pool;
+			return pool;
 		}
-		break;
-
-		case CURLINFO_HEADER_IN:
-			std::cout << "Received header (" << DebugInfoSize << "bytes)\n";
-			break;
-
-		case CURLINFO_HEADER_OUT:
+		
+		// buffers released while a thread shuts down skip its free lists
+		static shelf * local()
 		{
-			// C string is not null terminated:  https://curl.haxx.se/libcurl/c/CURLOPT_DEBUGFUNCTION.html
-
-			// Scan for \r\n\r\n.  According to some code in tool_cb_dbg.c, special processing is needed for
-			// CURLINFO_HEADER_OUT blocks when containing both headers and data (which may be binary).
-			//
-			// Truncate at 1023 characters. This is just an arbitrary number based on a buffer size seen in
-			// the libcurl code.
-			int RecalculatedSize = min(DebugInfoSize, (size_t)1023);
-			for (int Index = 0; Index <= RecalculatedSize - 4; ++Index)
+			if(retired)
 			{
-				if (DebugInfo[Index] == '\r' && DebugInfo[Index + 1] == '\n'
-					&& DebugInfo[Index + 2] == '\r' && DebugInfo[Index + 3] == '\n')
-				{
-					RecalculatedSize = Index;
-					break;
-				}
+				return nullptr;
 			}
-
-			// As lib/http.c states that CURLINFO_HEADER_OUT may contain binary data, only print it if
-			// the header data is readable.
-			bool bIsPrintable = true;
-			for (int Index = 0; Index < RecalculatedSize; ++Index)
+			static thread_local thread_shelf lists;
+			return &lists;
+		}
+		
+		// sizes past the largest class go unpooled, and stopping there keeps the doubling below from overflowing
+		static std::size_t class_of(std::size_t bytes)
+		{
+			if(bytes > block_size(classes - 1))
 			{
-				unsigned char Ch = DebugInfo[Index];
-				if (!isprint(Ch) && !isspace(Ch))
+				return classes;
+			}
+			std::size_t index = 0;
+			for(std::size_t block = smallest; block < bytes; block <<= 1)
+			{
+				++index;
+			}
+			return index;
+		}
+		
+		static std::size_t block_size(std::size_t index)
+		{
+			return smallest << index;
+		}
+		
+		void * allocate(std::size_t bytes, std::size_t & granted)
+		{
+			std::size_t index = class_of(bytes);
+			if(index >= classes)
+			{
+				++misses;
+				granted = bytes;
+				return malloc(bytes);
+			}
+			granted = block_size(index);
+			shelf * lists = local();
+			node * n = lists ? lists->pop(index) : nullptr;
+			if(!n)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				n = shared.pop(index);
+			}
+			if(n)
+			{
+				++hits;
+				retained -= granted;
+				return n;
+			}
+			++misses;
+			return malloc(granted);
+		}
+		
+		void release(void * data, std::size_t bytes)
+		{
+			if(!data)
+			{
+				return;
+			}
+			std::size_t index = class_of(bytes);
+			if(index >= classes || block_size(index) != bytes || retained.fetch_add(bytes) + bytes > limit)
+			{
+				if(index < classes && block_size(index) == bytes)
 				{
-					bIsPrintable = false;
-					break;
+					retained -= bytes;
 				}
+				free(data);
+				return;
 			}
-
-			if (bIsPrintable)
+			shelf * lists = local();
+			if(lists && lists->counts[index] < local_limit)
 			{
-				std::string DebugText(DebugInfo, RecalculatedSize);
+				lists->push(index, (node *) data);
+			}
+			else
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				shared.push(index, (node *) data);
+			}
+		}
+		
+		// move the first count bytes to a buffer of at least wanted bytes
+		void * resize(void * data, std::size_t bytes, std::size_t wanted, std::size_t count, std::size_t & granted)
+		{
+			if(data && class_of(bytes) >= classes && class_of(wanted) >= classes)
+			{
+				void * aux = realloc(data, wanted);
+				granted = aux ? wanted : bytes;
+				return aux;
+			}
+			void * aux = allocate(wanted, granted);
+			if(aux && data)
+			{
+				memcpy(aux, data, count);
+				release(data, bytes);
+			}
+			else if(!aux)
+			{
+				granted = bytes;
+			}
+			return aux;
+		}
+	};
+	
+	public:
+	
+	struct chunk
+	{
+		std::size_t size;
+		std::size_t capacity;
+		char * data;
+		
+		// body length announced by the server, reserved on the first write
+		std::size_t expected = 0;
+		
+		// an announced length is only trusted this far, a larger body grows as it actually arrives
+		static constexpr std::size_t max_reserve = std::size_t(8) << 20;
+		
+		// where the buffer comes from, the buffer pool when null
+		std::pmr::memory_resource * resource = nullptr;
+		
+		// past this many bytes the data moves to disk, zero keeps everything in memory
+		std::size_t limit = 0;
+		
+		// the temporary file while spilling, and whether data is a read-only mapping of it
+		int spill = -1;
+		bool mapped = false;
+		
+		// typical response headers and tiny bodies live here without an allocation, kept small because every package holds two
+		// a body up to 2 KB takes one buffer from the thread's pool instead, which bench.cpp measures as cheaper than a larger package
+		static constexpr std::size_t inline_capacity = 512;
+		char local[inline_capacity];
+		
+		bool is_inline() const
+		{
+			return data == local;
+		}
 
-				//findAndReplaceAll(DebugText, "\n", "");
-				//findAndReplaceAll(DebugText, "\r", "");
+		// inline data has to be copied across, buffers elsewhere just change hands
+		friend void swap(chunk & x, chunk & y) noexcept
+		{
+			using std::swap;
+			bool x_inline = x.is_inline();
+			bool y_inline = y.is_inline();
+			if(x_inline && y_inline)
+			{
+				char temp[inline_capacity];
+				memcpy(temp, x.local, x.size + 1);
+				memcpy(x.local, y.local, y.size + 1);
+				memcpy(y.local, temp, x.size + 1);
+			}
+			else if(x_inline)
+			{
+				memcpy(y.local, x.local, x.size + 1);
+				x.data = y.data;
+				y.data = y.local;
+			}
+			else if(y_inline)
+			{
+				memcpy(x.local, y.local, y.size + 1);
+				y.data = x.data;
+				x.data = x.local;
+			}
+			else
+			{
+				swap(x.data, y.data);
+			}
+			swap(x.size, y.size);
+			swap(x.capacity, y.capacity);
+			swap(x.expected, y.expected);
+			swap(x.resource, y.resource);
+			swap(x.limit, y.limit);
+			swap(x.spill, y.spill);
+			swap(x.mapped, y.mapped);
+		}
+		
+		void * obtain(std::size_t bytes, std::size_t & granted)
+		{
+			if(resource)
+			{
+				granted = bytes;
+				return resource->allocate(bytes, alignof(std::max_align_t));
+			}
+			return buffer_pool::instance().allocate(bytes, granted);
+		}
+		
+		void give_back(void * buffer, std::size_t bytes)
+		{
+			if(resource)
+			{
+				resource->deallocate(buffer, bytes, alignof(std::max_align_t));
+			}
+			else
+			{
+				buffer_pool::instance().release(buffer, bytes);
+			}
+		}
 
-				std::cout << "Sent header (" << RecalculatedSize << " bytes) - " << DebugText << "\n";
+		chunk(std::size_t s = 0, std::pmr::memory_resource * r = nullptr) : size(s), capacity(s), resource(r)
+		{
+			if(size < inline_capacity)
+			{
+				data = local;
+				capacity = inline_capacity - 1;
+				data[size] = '\0';
+				return;
+			}
+			std::size_t granted = 0;
+			data = (char *)obtain(sizeof(char) * (capacity + 1), granted);
+			if (data)
+			{
+				capacity = granted - 1;
+				data[size] = '\0';
 			}
 			else
 			{
-				std::cout << "Sent header (" << RecalculatedSize << " bytes) - contains binary data\n";
+				size = 0;
+				capacity = 0;
 			}
 		}
-		break;
 
-		case CURLINFO_DATA_IN:
-			std::cout << "Received data (" << DebugInfoSize << " bytes)\n";
-			break;
+		// like the standard pmr containers, a copy does not inherit the memory resource, and it is always kept in memory
+		chunk(chunk const & other) : size(other.data ? other.size : 0), capacity(size)
+		{
+			if(size < inline_capacity)
+			{
+				data = local;
+				capacity = inline_capacity - 1;
+				if(size)
+				{
+					memcpy(data, other.data, size);
+				}
+				data[size] = '\0';
+				return;
+			}
+			std::size_t granted = 0;
+			data = (char *)obtain(sizeof(char) * (capacity + 1), granted);
+			if (data)
+			{
+				capacity = granted - 1;
+				memcpy(data, other.data, size);
+				data[size] = '\0';
+			}
+			else
+			{
+				size = 0;
+				capacity = 0;
+			}
+		}
 
-		case CURLINFO_DATA_OUT:
-			std::cout << "Sent data (" << DebugInfoSize << " bytes)\n";
-			break;
+		// forget the data but keep the buffer for the next transfer
+		void clear()
+		{
+			if(mapped || spill >= 0)
+			{
+				drop();
+			}
+			size = 0;
+			expected = 0;
+			if(data)
+			{
+				data[0] = '\0';
+			}
+		}
+		
+		// a moved-from chunk is left empty on its inline storage
+		chunk(chunk && other) noexcept : size(0), capacity(inline_capacity - 1), data(local)
+		{
+			local[0] = '\0';
+			swap(*this, other);
+		}
 
-		case CURLINFO_SSL_DATA_IN:
-			std::cout << "Received SSL data (" << DebugInfoSize << " bytes)\n";
-			break;
+		chunk & operator=(chunk other)
+		{
+			swap(*this, other);
+			return *this;
+		}
 
-		case CURLINFO_SSL_DATA_OUT:
-			std::cout << "Sent SSL data (" << DebugInfoSize << " bytes)\n";
-			break;
+		~chunk()
+		{
+			drop();
+			size = 0;
+		}
+		
+		// release the buffer, the mapping or the temporary file, whichever holds the data
+		void drop()
+		{
+			if (data)
+			{
+#ifndef WINDOWS
+				if(mapped)
+				{
+					munmap(data, size);
+				}
+				else
+#endif
+				if(!is_inline())
+				{
+					// hand the buffer back to the pool so the next response can reuse it
+					give_back(data, capacity + 1);
+				}
+				data = nullptr;
+			}
+			capacity = 0;
+			mapped = false;
+#ifndef WINDOWS
+			if(spill >= 0)
+			{
+				close(spill);
+				spill = -1;
+			}
+#endif
+		}
+		
+		// make room for at least n bytes, plus the null terminator
+		bool reserve(std::size_t n)
+		{
+			if(mapped || spill >= 0)
+			{
+				return false;
+			}
+			if(!data && n < inline_capacity)
+			{
+				data = local;
+				capacity = inline_capacity - 1;
+				return true;
+			}
+			if(n > capacity || !data)
+			{
+				std::size_t granted = 0;
+				char * aux = nullptr;
+				if(is_inline())
+				{
+					// promote to the heap once the inline storage is outgrown
+					aux = (char *)obtain(sizeof(char) * (n + 1), granted);
+					if(aux)
+					{
+						memcpy(aux, data, size);
+					}
+				}
+				else if(resource)
+				{
+					aux = (char *)obtain(sizeof(char) * (n + 1), granted);
+					if(aux && data)
+					{
+						memcpy(aux, data, size);
+						give_back(data, capacity + 1);
+					}
+				}
+				else
+				{
+					aux = (char *)buffer_pool::instance().resize(data, data ? capacity + 1 : 0, sizeof(char) * (n + 1), size, granted);
+				}
+				if(!aux)
+				{
+					return false;
+				}
+				data = aux;
+				capacity = granted - 1;
+			}
+			return true;
+		}
+		
+		bool append(char const * buffer, std::size_t length)
+		{
+#ifndef WINDOWS
+			if(spill >= 0 || mapped || (limit && size + length > limit))
+			{
+				return append_to_disk(buffer, length);
+			}
+#endif
+			if(size + length > capacity)
+			{
+				// grow geometrically so a large body only costs a logarithmic number of reallocations
+				if(!reserve(std::max(size + length, capacity * 2)) && !reserve(size + length))
+				{
+					return false;
+				}
+			}
+			memcpy(data + size, buffer, length);
+			size += length;
+			data[size] = '\0';
+			return true;
+		}
 
-		default:
-			std::cerr << "DebugCallback: Unknown DebugInfoType=" << (int)DebugInfoType << "(DebugInfoSize: " << DebugInfoSize << " bytes)\n";
-			break;
+#ifndef WINDOWS
+		static bool write_all(int fd, char const * buffer, std::size_t length)
+		{
+			while(length)
+			{
+				ssize_t written = write(fd, buffer, length);
+				if(written < 0)
+				{
+					if(errno == EINTR)
+					{
+						continue;
+					}
+					return false;
+				}
+				buffer += written;
+				length -= static_cast<std::size_t>(written);
+			}
+			return true;
+		}
+		
+		// an anonymous file in TMPDIR, nothing is left behind if the process dies
+		static int open_spill()
+		{
+			char const * directory = getenv("TMPDIR");
+			if(!directory || !*directory)
+			{
+				directory = "/tmp";
+			}
+			int fd = -1;
+#ifdef O_TMPFILE
+			fd = open(directory, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+#endif
+			if(fd < 0)
+			{
+				// file systems without O_TMPFILE get a named file, unlinked right away
+				std::string path = std::string(directory) + "/minicurl-XXXXXX";
+				fd = mkstemp(&path[0]);
+				if(fd >= 0)
+				{
+					unlink(path.c_str());
+				}
+			}
+			return fd;
+		}
+		
+		bool append_to_disk(char const * buffer, std::size_t length)
+		{
+			if(spill < 0)
+			{
+				// move what is already buffered or mapped to the file, then free the memory
+				int fd = open_spill();
+				if(fd < 0 || (data && !write_all(fd, data, size)))
+				{
+					if(fd >= 0)
+					{
+						close(fd);
+					}
+					return false;
+				}
+				drop();
+				spill = fd;
+			}
+			if(!write_all(spill, buffer, length))
+			{
+				return false;
+			}
+			size += length;
+			return true;
+		}
+#endif
+		
+		// once the transfer is over, map spilled data read-only so it reads like a buffer, without the null terminator
+		bool seal()
+		{
+#ifndef WINDOWS
+			if(spill >= 0)
+			{
+				void * view = size ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, spill, 0) : MAP_FAILED;
+				close(spill);
+				spill = -1;
+				if(view == MAP_FAILED)
+				{
+					size = 0;
+					return false;
+				}
+				madvise(view, size, MADV_SEQUENTIAL);
+				data = (char *)view;
+				mapped = true;
+			}
+#endif
+			return true;
+		}
+		
+		void save(std::iostream& file)
+		{
+			// persist data as is, without the null terminator
+			file.write(data, size);
+			file.flush();
+		}
+		
+		// borrow the data without copying it, valid as long as the chunk is neither changed nor destroyed
+		std::string_view view() const
+		{
+			return data ? std::string_view(data, size) : std::string_view();
+		}
+		
+		std::string to_string() const
+		{
+			std::string content = "";
+			if(size && data)
+			{
+				content = std::string(data, size);
+			}
+			return content;
+		}
+	};
+	
+	struct package
+	{
+		std::size_t status = 0;
+		chunk header;
+		chunk content;
+		
+		// bytes libcurl allocated for a blocking transfer, only counted with the counting allocator installed
+		std::size_t library_bytes = 0;
+		
+		// where a header line of the last response sits in header, as offsets so the buffer may grow
+		struct field
+		{
+			std::uint32_t name = 0;
+			std::uint32_t name_length = 0;
+			std::uint32_t value = 0;
+			std::uint32_t value_length = 0;
+		};
+		
+		// filled by the header callback as lines arrive, lines past the last slot are found by scanning
+		static constexpr std::size_t indexed_fields = 32;
+		field fields[indexed_fields];
+		std::size_t field_count = 0;
+		
+		static bool parse_field(char const * text, std::size_t offset, std::size_t length, field & out)
+		{
+			char const * line = text + offset;
+			char const * colon = (char const *) memchr(line, ':', length);
+			if(!colon)
+			{
+				return false;
+			}
+			std::size_t begin = static_cast<std::size_t>(colon - line) + 1;
+			std::size_t end = length;
+			while(begin < end && (line[begin] == ' ' || line[begin] == '\t'))
+			{
+				++begin;
+			}
+			while(end > begin && (line[end - 1] == '\r' || line[end - 1] == '\n' || line[end - 1] == ' ' || line[end - 1] == '\t'))
+			{
+				--end;
+			}
+			out.name = static_cast<std::uint32_t>(offset);
+			out.name_length = static_cast<std::uint32_t>(colon - line);
+			out.value = static_cast<std::uint32_t>(offset + begin);
+			out.value_length = static_cast<std::uint32_t>(end - begin);
+			return true;
+		}
+		
+		// record the header line just appended at offset
+		void index_line(std::size_t offset, std::size_t length)
+		{
+			// a status line starts over, earlier responses belong to redirects or interim responses
+			if(length >= 5 && memcmp(header.data + offset, "HTTP/", 5) == 0)
+			{
+				field_count = 0;
+			}
+			else if(field_count < indexed_fields && parse_field(header.data, offset, length, fields[field_count]))
+			{
+				++field_count;
+			}
+		}
+		
+		// rebuild the index of headers that did not come through the header callback
+		void reindex()
+		{
+			field_count = 0;
+			for(std::size_t offset = 0; offset < header.size && header.data;)
+			{
+				char const * end = (char const *) memchr(header.data + offset, '\n', header.size - offset);
+				std::size_t length = end ? static_cast<std::size_t>(end - header.data) + 1 - offset : header.size - offset;
+				index_line(offset, length);
+				offset += length;
+			}
+		}
+		
+		// value of the first header of the last response with the given name, compared ignoring case, empty when missing
+		std::string_view header_value(std::string_view name) const
+		{
+			for(std::size_t i = 0; i < field_count; ++i)
+			{
+				if(fields[i].name_length == name.size() && starts_with_nocase(header.data + fields[i].name, name.size(), name.data(), name.size()))
+				{
+					return std::string_view(header.data + fields[i].value, fields[i].value_length);
+				}
+			}
+			if(field_count == indexed_fields)
+			{
+				// unusually many headers, look past the last indexed one
+				field const & last = fields[indexed_fields - 1];
+				char const * next = (char const *) memchr(header.data + last.value, '\n', header.size - last.value);
+				std::size_t offset = next ? static_cast<std::size_t>(next - header.data) + 1 : header.size;
+				while(offset < header.size)
+				{
+					char const * end = (char const *) memchr(header.data + offset, '\n', header.size - offset);
+					std::size_t length = end ? static_cast<std::size_t>(end - header.data) + 1 - offset : header.size - offset;
+					field found;
+					if(parse_field(header.data, offset, length, found) && found.name_length == name.size() && starts_with_nocase(header.data + offset, name.size(), name.data(), name.size()))
+					{
+						return std::string_view(header.data + found.value, found.value_length);
+					}
+					offset += length;
+				}
+			}
+			return std::string_view();
+		}
+		
+		// the range a partial response carries, from Content-Range: bytes first-last/total, total is zero when unknown
+		bool content_range(std::size_t & first, std::size_t & last, std::size_t & total) const
+		{
+			std::string_view value = header_value("Content-Range");
+			if(!starts_with_nocase(value.data(), value.size(), "bytes "))
+			{
+				return false;
+			}
+			std::size_t i = strlen("bytes ");
+			auto number = [&](std::size_t & out)
+			{
+				return parse_decimal(value.data(), value.size(), i, out);
+			};
+			if(!number(first) || i == value.size() || value[i++] != '-' || !number(last) || last < first || i == value.size() || value[i++] != '/')
+			{
+				return false;
+			}
+			if(!number(total))
+			{
+				total = 0;
+			}
+			return true;
+		}
+		
+		// announced body length of the last response, zero when missing
+		std::size_t content_length() const
+		{
+			std::string_view value = header_value("Content-Length");
+			std::size_t i = 0;
+			std::size_t length = 0;
+			return parse_decimal(value.data(), value.size(), i, length) ? length : 0;
+		}
+		
+		// response not found
+#pragma region Error Handling
+		bool isValid() const
+		{
+			return !isEmpty() && !hasErrors();
+		}
+		
+		bool hasErrors() const
+		{
+			std::string_view response = content.view();
+			return isNotFound(response) || isNotAuthorized(response);
+		}
+
+		bool isNotFound() const
+		{
+			return isNotFound(content.view());
+		}
+
+		bool isEmpty() const
+		{
+			return content.size == 0;
+		}
+
+		static bool isNotFound(std::string_view response)
+		{
+			return response.find("<title>404 ") != std::string_view::npos;
+		}
+
+		bool isNotAuthorized() const
+		{
+			return isNotAuthorized(content.view());
+		}
+
+		// response not authorized
+		static bool isNotAuthorized(std::string_view response)
+		{
+			return response.find("<title>403 ") != std::string_view::npos;
+		}
+#pragma endregion
+
+		void save(std::iostream& file)
+		{
+			content.save(file);
+		}
+		
+		friend void swap(package & x, package & y)
+		{
+			using std::swap;
+			swap(x.status, y.status);
+			swap(x.header, y.header);
+			swap(x.content, y.content);
+			swap(x.library_bytes, y.library_bytes);
+			swap(x.fields, y.fields);
+			swap(x.field_count, y.field_count);
+		}
+		
+		// forget the response but keep the buffers for the next transfer
+		void clear()
+		{
+			status = 0;
+			header.clear();
+			content.clear();
+			field_count = 0;
+		}
+		
+		package()
+		{
+		}
+		
+		// header and content buffers come from the given memory resource, which must outlive the package
+		explicit package(std::pmr::memory_resource * resource) : header(0, resource), content(0, resource)
+		{
+		}
+		
+		package(std::size_t s, chunk const & h, chunk const & c) : status(s), header(h), content(c)
+		{
+			reindex();
+		}
+		
+		package(std::size_t s, chunk && h, chunk && c) : status(s), header(std::move(h)), content(std::move(c))
+		{
+			reindex();
+		}
+		
+		package(package const & other) : status(other.status), header(other.header), content(other.content), library_bytes(other.library_bytes), field_count(other.field_count)
+		{
+			std::copy(other.fields, other.fields + other.field_count, fields);
+		}
+		
+		package(package && other) noexcept : status(other.status), header(std::move(other.header)), content(std::move(other.content)), library_bytes(other.library_bytes), field_count(other.field_count)
+		{
+			std::copy(other.fields, other.fields + other.field_count, fields);
+			other.status = 0;
+			other.library_bytes = 0;
+			other.field_count = 0;
+		}
+		
+		package& operator=(package other)
+		{
+			swap(*this, other);
+			return *this;
+		}
+		
+		~package()
+		{
+			status = 0;
+		}
+	};
+	
+	// what a streaming consumer wants done after being handed a block of the body
+	enum class stream_action
+	{
+		proceed,
+		pause,
+		abort
+	};
+	
+	// outcome of a transfer into a buffer owned by the caller
+	struct fill_result
+	{
+		std::size_t status = 0;
+		std::size_t size = 0;
+		bool truncated = false;
+	};
+	
+	private:
+	
+	static std::pmr::vector<std::pmr::string> split(std::string const & data, std::string const & delimiters = " \n\t", std::pmr::memory_resource * resource = std::pmr::get_default_resource())
+	{
+		std::pmr::vector<std::pmr::string> tokens(resource);
+		size_t const size = data.size();
+		if(size)
+		{
+			std::size_t current = 0;
+			for(std::size_t i = 0; i < size; ++i)
+			{
+				if(strchr(delimiters.c_str(), data[i]))
+				{
+					tokens.emplace_back(&(data[current]), (i - current));
+					current = i + 1;
+				}
+			}
+			tokens.emplace_back(&(data[current]), (size - current));
+		}
+		return tokens;
+	}
+
+	static bool contains(char const * text, std::size_t size, char const * what)
+	{
+		return std::search(text, text + size, what, what + strlen(what)) != text + size;
+	}
+	
+	// libcurl only reports cache hits through its informational messages, and their wording changes between releases
+	static void count_cache_hits(minicurl * self, char const * text, std::size_t size)
+	{
+		if(self)
+		{
+			if(contains(text, size, "found in DNS cache"))
+			{
+				++self->shared.dns_hits;
+			}
+			else if(contains(text, size, "SSL re-using session ID") || contains(text, size, "SSL reusing session"))
+			{
+				++self->shared.tls_resumptions;
+			}
+			else if(contains(text, size, "Re-using existing connection"))
+			{
+				++self->shared.connections_reused;
+			}
+		}
+	}
+	
+	// host part of an url, without scheme, credentials, port, path or query
+	static std::string get_host(std::string const & url)
+	{
+		std::size_t begin = url.find("://");
+		begin = (begin == std::string::npos) ? 0 : begin + 3;
+		std::size_t end = url.find_first_of("/?#", begin);
+		std::string authority = url.substr(begin, (end == std::string::npos) ? std::string::npos : end - begin);
+		std::size_t at = authority.rfind('@');
+		if(at != std::string::npos)
+		{
+			authority.erase(0, at + 1);
+		}
+		if(authority.size() && authority[0] == '[')
+		{
+			return authority.substr(0, authority.find(']') + 1);
+		}
+		return authority.substr(0, authority.find(':'));
+	}
+	
+	static size_t debug_function(CURL * Handle, curl_infotype DebugInfoType, char * DebugInfo, size_t DebugInfoSize, void* UserData)
+	{
+		switch (DebugInfoType)
+		{
+		case CURLINFO_TEXT:
+		{
+			count_cache_hits((minicurl *)UserData, DebugInfo, DebugInfoSize);
+
+			// in this case DebugInfo is a C string (see http://curl.haxx.se/libcurl/c/debug.html)
+			// C string is not null terminated:  https://curl.haxx.se/libcurl/c/CURLOPT_DEBUGFUNCTION.html
+
+			// Truncate at 1023 characters. This is just an arbitrary number based on a buffer size seen in
+			// the libcurl code.
+			DebugInfoSize = std::min(DebugInfoSize, (size_t)1023);
+
+			// Calculate the actual length of the string due to incorrect use of snprintf() in lib/vtls/openssl.c.
+			char* FoundNulPtr = (char*)memchr(DebugInfo, 0, DebugInfoSize);
+			int CalculatedSize = FoundNulPtr != nullptr ? FoundNulPtr - DebugInfo : DebugInfoSize;
+
+			std::string DebugText(DebugInfo, CalculatedSize);
+
+			//findAndReplaceAll(DebugText, "\n", "");
+			//findAndReplaceAll(DebugText, "\r", "");
+
+			std::cout << DebugText << "\n";
+		}
+		break;
+
+		case CURLINFO_HEADER_IN:
+			std::cout << "Received header (" << DebugInfoSize << "bytes)\n";
+			break;
+
+		case CURLINFO_HEADER_OUT:
+		{
+			// C string is not null terminated:  https://curl.haxx.se/libcurl/c/CURLOPT_DEBUGFUNCTION.html
+
+			// Scan for \r\n\r\n.  According to some code in tool_cb_dbg.c, special processing is needed for
+			// CURLINFO_HEADER_OUT blocks when containing both headers and data (which may be binary).
+			//
+			// Truncate at 1023 characters. This is just an arbitrary number based on a buffer size seen in
+			// the libcurl code.
+			int RecalculatedSize = std::min(DebugInfoSize, (size_t)1023);
+			for (int Index = 0; Index <= RecalculatedSize - 4; ++Index)
+			{
+				if (DebugInfo[Index] == '\r' && DebugInfo[Index + 1] == '\n'
+					&& DebugInfo[Index + 2] == '\r' && DebugInfo[Index + 3] == '\n')
+				{
+					RecalculatedSize = Index;
+					break;
+				}
+			}
+
+			// As lib/http.c states that CURLINFO_HEADER_OUT may contain binary data, only print it if
+			// the header data is readable.
+			bool bIsPrintable = true;
+			for (int Index = 0; Index < RecalculatedSize; ++Index)
+			{
+				unsigned char Ch = DebugInfo[Index];
+				if (!isprint(Ch) && !isspace(Ch))
+				{
+					bIsPrintable = false;
+					break;
+				}
+			}
+
+			if (bIsPrintable)
+			{
+				std::string DebugText(DebugInfo, RecalculatedSize);
+
+				//findAndReplaceAll(DebugText, "\n", "");
+				//findAndReplaceAll(DebugText, "\r", "");
+
+				std::cout << "Sent header (" << RecalculatedSize << " bytes) - " << DebugText << "\n";
+			}
+			else
+			{
+				std::cout << "Sent header (" << RecalculatedSize << " bytes) - contains binary data\n";
+			}
+		}
+		break;
+
+		case CURLINFO_DATA_IN:
+			std::cout << "Received data (" << DebugInfoSize << " bytes)\n";
+			break;
+
+		case CURLINFO_DATA_OUT:
+			std::cout << "Sent data (" << DebugInfoSize << " bytes)\n";
+			break;
+
+		case CURLINFO_SSL_DATA_IN:
+			std::cout << "Received SSL data (" << DebugInfoSize << " bytes)\n";
+			break;
+
+		case CURLINFO_SSL_DATA_OUT:
+			std::cout << "Sent SSL data (" << DebugInfoSize << " bytes)\n";
+			break;
+
+		default:
+			std::cerr << "DebugCallback: Unknown DebugInfoType=" << (int)DebugInfoType << "(DebugInfoSize: " << DebugInfoSize << " bytes)\n";
+			break;
+		}
+
+		return DebugInfoSize;
+	}
+	
+	static size_t write_function(void * buffer, std::size_t size, std::size_t count, void * stream)
+	{
+		std::size_t realsize = size * count;
+		chunk * memory = (chunk *) stream;
+		if(memory->size == 0 && memory->expected > memory->capacity)
+		{
+			// best effort, the body still grows geometrically if the announced length cannot be reserved
+			// a body announced past the memory limit only reserves up to it, the rest goes to disk
+			memory->reserve(std::min(memory->limit ? std::min(memory->expected, memory->limit) : memory->expected, chunk::max_reserve));
+		}
+		return memory->append((char const *) buffer, realsize) ? realsize : 0;
+	}
+	
+	// the digits at text[i], false when there are none or they overflow, i ends past them
+	static bool parse_decimal(char const * text, std::size_t size, std::size_t & i, std::size_t & out)
+	{
+		std::size_t begin = i;
+		out = 0;
+		while(i < size && text[i] >= '0' && text[i] <= '9')
+		{
+			std::size_t digit = static_cast<std::size_t>(text[i++] - '0');
+			if(out > (std::numeric_limits<std::size_t>::max() - digit) / 10)
+			{
+				return false;
+			}
+			out = out * 10 + digit;
+		}
+		return i > begin;
+	}
+	
+	static bool starts_with_nocase(char const * text, std::size_t size, char const * prefix)
+	{
+		return starts_with_nocase(text, size, prefix, strlen(prefix));
+	}
+	
+	static bool starts_with_nocase(char const * text, std::size_t size, char const * prefix, std::size_t length)
+	{
+		if(size < length)
+		{
+			return false;
+		}
+		for(std::size_t i = 0; i < length; ++i)
+		{
+			if(std::tolower((unsigned char) text[i]) != std::tolower((unsigned char) prefix[i]))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+	
+	// collect and index the header lines, and remember the announced body length so the first body write can reserve it
+	static size_t header_function(void * buffer, std::size_t size, std::size_t count, void * stream)
+	{
+		std::size_t realsize = size * count;
+		package * response = (package *) stream;
+		char const * line = (char const *) buffer;
+		if(starts_with_nocase(line, realsize, "Content-Length:"))
+		{
+			std::size_t length = 0;
+			std::size_t i = strlen("Content-Length:");
+			while(i < realsize && (line[i] == ' ' || line[i] == '\t'))
+			{
+				++i;
+			}
+			if(!parse_decimal(line, realsize, i, length))
+			{
+				// missing or too long to be real, reserve nothing and let the body grow as it arrives
+				length = 0;
+			}
+			response->content.expected = length > std::numeric_limits<std::size_t>::max() - response->content.size ? 0 : response->content.size + length;
+		}
+		std::size_t offset = response->header.size;
+		if(!response->header.append(line, realsize))
+		{
+			return 0;
+		}
+		response->index_line(offset, realsize);
+		return realsize;
+	}
+	
+	// apply the options every transfer has in common, the attachments must outlive the transfer
+	void prepare(CURL * curl, config const & options, std::string const & url, std::string const & payload, std::vector<std::string> const & headers, package & response, attachments & attached)
+	{
+		// share resolver results and tls sessions with every other handle
+		curl_easy_setopt(curl, CURLOPT_SHARE, shared.handle);
+
+		// timeouts must not rely on signals when many threads run transfers at once
+		curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+
+		// keep read timeout small because we are supporting retries
+		curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, options.timeout_ms);
+
+		curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_function);
+		curl_easy_setopt(curl, CURLOPT_HEADERDATA, (void *) &response);
+
+		// Always setup the debug function to allow for activity to be tracked
+		curl_easy_setopt(curl, CURLOPT_DEBUGDATA, this);
+		curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, debug_function);
+		curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
+		
+		if(payload.size())
+		{
+			curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payload.c_str());
+		}
+		
+		// the header strings built here come from the same memory resource as the response
+		std::pmr::memory_resource * resource = response.header.resource ? response.header.resource : std::pmr::get_default_resource();
+		bool bHasContentLength = false;
+		struct curl_slist * header_list = nullptr;
+		for(std::string const & line : headers)
+		{
+			if(line.size())
+			{
+				std::pmr::string h(line.data(), line.size(), resource);
+				auto tokens = split(line, ":", resource);
+				if((tokens.size() == 1 || (tokens.size() == 2 && tokens[1].empty())) && tokens[0].back() != ';')
+				{
+					if (tokens.front() == "Content-Length")
+						bHasContentLength = true;
+
+					h.assign(tokens.front());
+					h += ';';
+				}
+				header_list = curl_slist_append(header_list, h.c_str());
+			}
+		}
+
+		// content-length should be present http://www.w3.org/Protocols/rfc2616/rfc2616-sec4.html#sec4.4
+		if (bHasContentLength)
+			header_list = curl_slist_append(header_list, "Content-Length: -1");
+
+		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, header_list);
+		attached.header_list = header_list;
+		
+		attached.routes = routes.load();
+		if(curl_slist * resolve = attached.routes->resolve_entries())
+		{
+			curl_easy_setopt(curl, CURLOPT_RESOLVE, resolve);
+		}
+		if(attached.routes->connect_to_list)
+		{
+			curl_easy_setopt(curl, CURLOPT_CONNECT_TO, attached.routes->connect_to_list);
+		}
+		
+		// "unix:///run/agent.sock:/path" addresses /path through the given unix domain socket
+		std::string address;
+		std::string socket_path;
+		if(url.compare(0, 7, "unix://") == 0)
+		{
+			std::size_t separator = url.find(':', 7);
+			socket_path = url.substr(7, (separator == std::string::npos) ? std::string::npos : separator - 7);
+			std::string path = (separator == std::string::npos) ? "" : url.substr(separator + 1);
+			address = "http://localhost" + ((path.size() && path[0] == '/') ? path : "/" + path);
+		}
+		else if(options.unix_sockets.size())
+		{
+			auto found = options.unix_sockets.find(get_host(url));
+			if(found != options.unix_sockets.end())
+			{
+				socket_path = found->second;
+			}
+		}
+		if(socket_path.size())
+		{
+			curl_easy_setopt(curl, CURLOPT_UNIX_SOCKET_PATH, socket_path.c_str());
+		}
+		
+		curl_easy_setopt(curl, CURLOPT_URL, address.size() ? address.c_str() : url.c_str());
+		curl_easy_setopt(curl, CURLOPT_USERAGENT, options.user_agent.c_str());
+		curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, options.follow_location ? 1L : 0L);
+		
+		if(options.max_connects > 0)
+		{
+			curl_easy_setopt(curl, CURLOPT_MAXCONNECTS, options.max_connects);
+		}
+		
+		if(options.tcp_keepalive)
+		{
+			curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+			curl_easy_setopt(curl, CURLOPT_TCP_KEEPIDLE, options.keepalive_idle_seconds);
+			curl_easy_setopt(curl, CURLOPT_TCP_KEEPINTVL, options.keepalive_interval_seconds);
+		}
+		
+#if LIBCURL_VERSION_NUM >= 0x074100
+		// older libcurl cannot age out idle connections, only the pool evicts its idle handles
+		if(options.max_idle_seconds > 0)
+		{
+			curl_easy_setopt(curl, CURLOPT_MAXAGE_CONN, options.max_idle_seconds);
+		}
+#endif
+		
+		if(options.multiplex)
+		{
+#if LIBCURL_VERSION_NUM >= 0x073100
+			// prior knowledge lets cleartext servers speak h2c without an upgrade round trip
+			curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, options.prior_knowledge ? CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE : CURL_HTTP_VERSION_2TLS);
+#else
+			curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2_0);
+#endif
+			// rather wait for a connection that can multiplex than open a new one
+			curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+		}
+	}
+	
+#ifndef WINDOWS
+	// the file an upload reads from with pread straight into the libcurl buffer, no stdio in between
+	// not mapped, since a file shrinking during the upload would turn reads past its new end into SIGBUS
+	struct upload_source
+	{
+		int fd = -1;
+		std::size_t size = 0;
+		std::size_t position = 0;
+		
+		bool open(std::string const & filename)
+		{
+			struct stat file_stat;
+			if((fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC)) < 0 || fstat(fd, &file_stat) != 0)
+			{
+				return false;
+			}
+			size = static_cast<std::size_t>(file_stat.st_size);
+			
+			// ask the kernel to read ahead aggressively, the file is read once from start to end
+			posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+			return true;
+		}
+		
+		~upload_source()
+		{
+			if(fd >= 0)
+			{
+				close(fd);
+			}
+		}
+	};
+	
+	// a file that shrank gives a short read, which aborts the transfer with an error rather than a crash
+	static size_t read_function(char * buffer, std::size_t size, std::size_t count, void * stream)
+	{
+		upload_source * source = (upload_source *) stream;
+		std::size_t wanted = std::min(size * count, source->size - source->position);
+		ssize_t got = 0;
+		while((got = pread(source->fd, buffer, wanted, static_cast<off_t>(source->position))) < 0)
+		{
+			if(errno != EINTR)
+			{
+				return CURL_READFUNC_ABORT;
+			}
+		}
+		if(got == 0 && wanted)
+		{
+			// the file ended before the announced size, fail now rather than leave the server waiting
+			return CURL_READFUNC_ABORT;
+		}
+		source->position += static_cast<std::size_t>(got);
+		return static_cast<std::size_t>(got);
+	}
+	
+	// libcurl rewinds the upload when it has to send it again, after a redirect or an authentication round
+	static int seek_function(void * stream, curl_off_t offset, int origin)
+	{
+		upload_source * source = (upload_source *) stream;
+		if(origin != SEEK_SET || offset < 0 || static_cast<std::size_t>(offset) > source->size)
+		{
+			return CURL_SEEKFUNC_CANTSEEK;
+		}
+		source->position = static_cast<std::size_t>(offset);
+		return CURL_SEEKFUNC_OK;
+	}
+#endif
+	
+	package fetch(std::string const & url, std::string const & payload, std::string const & filename, std::vector<std::string> const & headers, std::pmr::memory_resource * resource = nullptr, std::size_t memory_limit = 0)
+	{
+		std::shared_ptr<const config> options = current();
+		package result(resource);
+		result.content.limit = memory_limit ? memory_limit : options->memory_limit;
+		std::size_t const allocated = counting::thread_allocated();
+		
+		if(url.size())
+		{
+			CURL * curl = checkout(*options);
+			if(curl)
+			{
+				curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_function);
+				curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&result.content);
+				
+#ifndef WINDOWS
+				upload_source upload_file;
+				if (filename.size() && upload_file.open(filename))
+				{
+					curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
+					curl_easy_setopt(curl, CURLOPT_READFUNCTION, read_function);
+					curl_easy_setopt(curl, CURLOPT_READDATA, (void *) &upload_file);
+					curl_easy_setopt(curl, CURLOPT_SEEKFUNCTION, seek_function);
+					curl_easy_setopt(curl, CURLOPT_SEEKDATA, (void *) &upload_file);
+					curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE, static_cast<curl_off_t>(upload_file.size));
+#if LIBCURL_VERSION_NUM >= 0x073e00
+					// fewer, larger reads per round trip through the read callback
+					curl_easy_setopt(curl, CURLOPT_UPLOAD_BUFFERSIZE, 512L * 1024L);
+#endif
+				}
+#else
+				// upload file handle
+				FILE * upload_file = nullptr;
+				
+				if (filename.size() && (upload_file = fopen(filename.c_str(), "rb")))
+				{
+					struct stat file_stat;
+					if (fstat(fileno(upload_file), &file_stat) == 0)
+					{
+						curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
+						curl_easy_setopt(curl, CURLOPT_READDATA, upload_file);
+						curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE, file_stat.st_size);
+					}
+				}
+#endif
+				
+				attachments attached;
+				prepare(curl, *options, url, payload, headers, result, attached);
+
+				CURLcode res = curl_easy_perform(curl);
+				
+				if(res == CURLE_OK)
+				{
+					long status_code = 0;
+					curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status_code);
+					result.status = static_cast<std::size_t>(status_code);
+				}
+				result.content.seal();
+
+#ifdef WINDOWS
+				if (upload_file)
+				{
+					fclose(upload_file);
+				}
+#endif
+
+				handles.checkin(curl);
+			}
+		}
+		
+		result.library_bytes = counting::thread_allocated() - allocated;
+		return result;
+	}
+	
+	template<typename Container>
+	struct append_target
+	{
+		Container * body;
+		
+		// a failed insert is held until libcurl has unwound and rethrown to the caller
+		std::exception_ptr failure;
+	};
+	
+	template<typename Container>
+	static size_t append_function(void * buffer, std::size_t size, std::size_t count, void * stream)
+	{
+		std::size_t realsize = size * count;
+		append_target<Container> * out = (append_target<Container> *) stream;
+		try
+		{
+			out->body->insert(out->body->end(), (char const *) buffer, (char const *) buffer + realsize);
+		}
+		catch(...)
+		{
+			out->failure = std::current_exception();
+			return 0;
+		}
+		return realsize;
+	}
+	
+	struct fixed_buffer
+	{
+		char * data;
+		std::size_t capacity;
+		std::size_t size;
+		bool truncated;
+	};
+	
+	// keep what fits and abort the transfer as soon as the body overflows the buffer
+	static size_t fixed_function(void * buffer, std::size_t size, std::size_t count, void * stream)
+	{
+		std::size_t realsize = size * count;
+		fixed_buffer * out = (fixed_buffer *) stream;
+		std::size_t room = out->capacity - out->size;
+		if(realsize > room)
+		{
+			memcpy(out->data + out->size, buffer, room);
+			out->size += room;
+			out->truncated = true;
+			return 0;
+		}
+		memcpy(out->data + out->size, buffer, realsize);
+		out->size += realsize;
+		return realsize;
+	}
+	
+	typedef size_t (*write_callback)(void *, std::size_t, std::size_t, void *);
+	
+	// blocking transfer handing the body to the given write callback, the headers go to response or else a per-thread scratch package
+	CURLcode fetch_to(std::string const & url, std::vector<std::string> const & headers, write_callback writer, void * target, std::size_t & status, std::function<void(CURL *)> const & setup = {}, package * response = nullptr)
+	{
+		static thread_local package scratch;
+		package & received = response ? *response : scratch;
+		received.clear();
+		status = 0;
+		
+		if(url.empty())
+		{
+			return CURLE_URL_MALFORMAT;
+		}
+		std::shared_ptr<const config> options = current();
+		CURL * curl = checkout(*options);
+		if(!curl)
+		{
+			return CURLE_FAILED_INIT;
+		}
+		
+		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writer);
+		curl_easy_setopt(curl, CURLOPT_WRITEDATA, target);
+		attachments attached;
+		prepare(curl, *options, url, "", headers, received, attached);
+		if(setup)
+		{
+			setup(curl);
+		}
+		
+		CURLcode res = curl_easy_perform(curl);
+		long status_code = 0;
+		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status_code);
+		status = static_cast<std::size_t>(status_code);
+		handles.checkin(curl);
+		return res;
+	}
+	
+	struct stream_state
+	{
+		CURL * curl;
+		std::function<stream_action(std::string_view)> const * consumer;
+		
+		// asked whether the consumer can take more, a paused transfer without one is resumed on the next tick
+		std::function<bool()> const * ready;
+		bool paused;
+		
+		// thrown by the consumer, held until libcurl has unwound and rethrown to the caller
+		std::exception_ptr failure;
+	};
+	
+	static size_t stream_function(void * buffer, std::size_t size, std::size_t count, void * stream)
+	{
+		std::size_t realsize = size * count;
+		stream_state * state = (stream_state *) stream;
+		stream_action action;
+		try
+		{
+			action = (*state->consumer)(std::string_view((char const *) buffer, realsize));
+		}
+		catch(...)
+		{
+			state->failure = std::current_exception();
+			return 0;
+		}
+		switch(action)
+		{
+		case stream_action::pause:
+			// libcurl keeps this block and offers it again once the transfer is resumed
+			state->paused = true;
+			return CURL_WRITEFUNC_PAUSE;
+		case stream_action::abort:
+			return 0;
+		default:
+			return realsize;
+		}
+	}
+	
+	// a paused transfer stops reading the socket, libcurl keeps calling this while it waits
+	static int resume_function(void * clientp, curl_off_t, curl_off_t, curl_off_t, curl_off_t)
+	{
+		stream_state * state = (stream_state *) clientp;
+		if(state->paused)
+		{
+			try
+			{
+				// the calling thread only waits on the socket meanwhile, and libcurl may not call again for a second
+				auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+				while(*state->ready && !(*state->ready)())
+				{
+					if(std::chrono::steady_clock::now() >= until)
+					{
+						return 0;
+					}
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+			}
+			catch(...)
+			{
+				state->failure = std::current_exception();
+				return 1;
+			}
+			state->paused = false;
+			curl_easy_pause(state->curl, CURLPAUSE_CONT);
+		}
+		return 0;
+	}
+	
+	std::size_t fetch_stream(std::string const & url, std::function<stream_action(std::string_view)> const & on_chunk, std::vector<std::string> const & headers, std::function<bool()> const & ready)
+	{
+		stream_state state = {nullptr, &on_chunk, &ready, false, nullptr};
+		std::size_t status = 0;
+		CURLcode res = fetch_to(url, headers, stream_function, &state, status, [&state](CURL * curl)
+		{
+			state.curl = curl;
+			curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, resume_function);
+			curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &state);
+			curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+		});
+		if(state.failure)
+		{
+			std::rethrow_exception(state.failure);
+		}
+		return (res == CURLE_OK) ? status : 0;
+	}
+	
+	template<typename Container>
+	fill_result fetch_into(std::string const & url, Container & body, std::vector<std::string> const & headers)
+	{
+		fill_result result;
+		body.clear();
+		std::size_t status = 0;
+		append_target<Container> target = {&body, nullptr};
+		if(fetch_to(url, headers, append_function<Container>, &target, status) == CURLE_OK)
+		{
+			result.status = status;
+		}
+		if(target.failure)
+		{
+			std::rethrow_exception(target.failure);
+		}
+		result.size = body.size();
+		return result;
+	}
+	
+	// what a partial download was fetched from, kept next to it so it can be resumed after a restart
+	struct checkpoint
+	{
+		std::string url;
+		
+		// strong etag or last-modified date, sent as If-Range so a changed resource is fetched whole
+		std::string validator;
+		std::size_t total = 0;
+		
+		// bytes of the partial file known to be on the device
+		std::size_t offset = 0;
+		
+		bool load(std::string const & path)
+		{
+			std::ifstream file(path, std::ifstream::binary);
+			std::string magic, total_text, offset_text;
+			if(!std::getline(file, magic) || magic != "minicurl-checkpoint 1" || !std::getline(file, url) || !std::getline(file, validator) || !std::getline(file, total_text) || !std::getline(file, offset_text))
+			{
+				return false;
+			}
+			total = strtoull(total_text.c_str(), nullptr, 10);
+			offset = strtoull(offset_text.c_str(), nullptr, 10);
+			return true;
+		}
+		
+		// written aside and renamed over the old one, so a crash leaves either checkpoint intact
+		bool save(std::string const & path) const
+		{
+			std::string temporary = path + ".tmp";
+			{
+				std::ofstream file(temporary, std::ofstream::binary | std::ofstream::trunc);
+				file << "minicurl-checkpoint 1\n" << url << "\n" << validator << "\n" << total << "\n" << offset << "\n";
+				file.flush();
+				if(!file.good())
+				{
+					return false;
+				}
+			}
+#ifdef WINDOWS
+			remove(path.c_str());
+#endif
+			return rename(temporary.c_str(), path.c_str()) == 0;
+		}
+	};
+	
+	struct file_sink
+	{
+		FILE * file;
+		
+		// the stdio buffer, owned by the caller because glibc ignores the size of a buffer it allocates itself
+		char * buffer;
+		std::size_t buffer_bytes;
+		std::size_t sync_bytes;
+		std::size_t unsynced;
+		
+		// bytes in the file, and where the current attempt started writing
+		std::size_t position;
+		std::size_t offset;
+		
+		std::string const * path;
+		std::string const * meta_path;
+		checkpoint * state;
+		CURL * curl;
+		package const * response;
+		bool checked;
+		
+		// the server failed this attempt, which is worth retrying unlike a refusal by the file
+		bool server_error;
+		
+		// the response did not continue the partial file, which was emptied to be fetched whole
+		bool restarted;
+	};
+	
+	// push buffered data to the file and, where possible, the file data to the device
+	static bool sync_file(FILE * file)
+	{
+		if(fflush(file) != 0)
+		{
+			return false;
+		}
+#ifndef WINDOWS
+		return fdatasync(fileno(file)) == 0;
+#else
+		return true;
+#endif
+	}
+	
+	// empty the file and write it from the start again
+	static bool restart_file(file_sink * sink)
+	{
+		if(!(sink->file = freopen(sink->path->c_str(), "wb", sink->file)))
+		{
+			return false;
+		}
+		setvbuf(sink->file, sink->buffer, sink->buffer ? _IOFBF : _IONBF, sink->buffer_bytes);
+		sink->position = 0;
+		sink->offset = 0;
+		sink->unsynced = 0;
+		return true;
+	}
+	
+	// a strong etag, or else the last-modified date, identifies this version of the resource
+	static std::string validator_of(package const & response)
+	{
+		std::string_view etag = response.header_value("ETag");
+		if(etag.size() && !starts_with_nocase(etag.data(), etag.size(), "W/"))
+		{
+			return std::string(etag);
+		}
+		return std::string(response.header_value("Last-Modified"));
+	}
+	
+	// on the first block, make sure a resumed response continues exactly the same resource, or start the file over
+	static bool accept_response(file_sink * sink)
+	{
+		long status_code = 0;
+		curl_easy_getinfo(sink->curl, CURLINFO_RESPONSE_CODE, &status_code);
+		if(status_code >= 400)
+		{
+			// an error page must not end up in the file
+			sink->server_error = status_code >= 500;
+			return false;
+		}
+		package const & response = *sink->response;
+		checkpoint & state = *sink->state;
+		std::string validator = validator_of(response);
+		std::size_t first = 0;
+		std::size_t last = 0;
+		std::size_t total = 0;
+		bool partial = status_code == 206 && response.content_range(first, last, total);
+		if(sink->offset)
+		{
+			if(partial && first == sink->offset && (!state.total || total == state.total) && (validator.empty() || validator == state.validator))
+			{
+				return true;
+			}
+			if(!restart_file(sink))
+			{
+				return false;
+			}
+			if(status_code != 200)
+			{
+				// a range of some other version of the resource, only a whole body may start the file
+				sink->restarted = true;
+				return false;
+			}
+		}
+		state.validator = validator;
+		state.total = partial ? total : response.content_length();
+		state.offset = 0;
+		return state.save(*sink->meta_path);
+	}
+	
+	static size_t file_function(void * buffer, std::size_t size, std::size_t count, void * stream)
+	{
+		std::size_t realsize = size * count;
+		file_sink * sink = (file_sink *) stream;
+		if(!sink->checked)
+		{
+			sink->checked = true;
+			if(!accept_response(sink))
+			{
+				return 0;
+			}
+		}
+		if(fwrite(buffer, 1, realsize, sink->file) != realsize)
+		{
+			return 0;
+		}
+		sink->position += realsize;
+		sink->unsynced += realsize;
+		if(sink->sync_bytes && sink->unsynced >= sink->sync_bytes)
+		{
+			// only bytes on the device may be recorded as done, or a crash could resume past a hole
+			if(!sync_file(sink->file))
+			{
+				return 0;
+			}
+			sink->unsynced = 0;
+			sink->state->offset = sink->position;
+			sink->state->save(*sink->meta_path);
+		}
+		return realsize;
+	}
+	
+	// make the rename of a file into this directory survive a crash
+	static void sync_directory(std::string const & filename)
+	{
+#ifndef WINDOWS
+		std::size_t slash = filename.rfind('/');
+		std::string directory = slash == std::string::npos ? "." : slash ? filename.substr(0, slash) : "/";
+		int fd = open(directory.c_str(), O_RDONLY | O_CLOEXEC);
+		if(fd >= 0)
+		{
+			fsync(fd);
+			close(fd);
+		}
+#endif
+	}
+	
+	// replace filename with the finished partial file in one step, readers see either the old file or the new one
+	static bool publish(std::string const & partial, std::string const & filename, bool durable)
+	{
+#ifdef WINDOWS
+		remove(filename.c_str());
+#endif
+		if(rename(partial.c_str(), filename.c_str()) != 0)
+		{
+			return false;
+		}
+		if(durable)
+		{
+			sync_directory(filename);
+		}
+		return true;
+	}
+	
+	// write the body to filename.part as it arrives and publish it when complete
+	// failed attempts are retried from the last byte received, and a partial file left by another process resumes from its checkpoint
+	bool fetch_file(std::string const & url, std::string const & filename, std::vector<std::string> const & headers, std::size_t & status)
+	{
+		std::shared_ptr<const config> options = current();
+		std::string partial = filename + ".part";
+		std::string meta = partial + ".meta";
+		status = 0;
+		
+		// only the part of an earlier partial file its checkpoint vouches for is kept
+		checkpoint state;
+		bool resumable = state.load(meta) && state.url == url;
+		if(!resumable)
+		{
+			state = checkpoint();
+			state.url = url;
+		}
+#ifndef WINDOWS
+		struct stat partial_stat;
+		if(!resumable || stat(partial.c_str(), &partial_stat) != 0 || static_cast<std::size_t>(partial_stat.st_size) < state.offset || truncate(partial.c_str(), static_cast<off_t>(state.offset)) != 0)
+		{
+			state.offset = 0;
+		}
+#else
+		state.offset = 0;
+#endif
+		FILE * file = fopen(partial.c_str(), state.offset ? "ab" : "wb");
+		if(!file)
+		{
+			return false;
+		}
+		
+		// one large buffer turns the many small blocks libcurl hands over into few large writes, it must outlive the file
+		std::unique_ptr<char[]> buffer(options->write_buffer_bytes ? new char[options->write_buffer_bytes] : nullptr);
+		setvbuf(file, buffer.get(), buffer ? _IOFBF : _IONBF, options->write_buffer_bytes);
+		
+		package response;
+		file_sink sink = {file, buffer.get(), options->write_buffer_bytes, options->sync_bytes, 0, state.offset, state.offset, &partial, &meta, &state, nullptr, &response, false, false, false};
+		std::string range;
+		auto setup = [&](CURL * curl)
+		{
+			sink.curl = curl;
+			if(sink.offset)
+			{
+				// a plain range rather than a resume offset, so a server answering with the whole file restarts it instead of failing
+				curl_easy_setopt(curl, CURLOPT_RANGE, range.c_str());
+			}
+		};
+		
+		CURLcode res = CURLE_OK;
+		bool refused = false;
+		std::size_t stalled = 0;
+		while(true)
+		{
+			sink.offset = sink.position;
+			sink.checked = false;
+			sink.server_error = false;
+			sink.restarted = false;
+			range = std::to_string(sink.offset) + "-";
+			std::vector<std::string> request_headers(headers);
+			if(sink.offset && state.validator.size())
+			{
+				request_headers.push_back("If-Range: " + state.validator);
+			}
+			
+			res = fetch_to(url, request_headers, file_function, &sink, status, setup, &response);
+			refused = status >= 400 && status < 500;
+			bool complete = res == CURLE_OK && status < 400 && (!state.total || sink.position == state.total);
+			if(complete || !sink.file)
+			{
+				break;
+			}
+			if(sink.restarted)
+			{
+				// ask again from the first byte, without a range the answer can only be the whole resource
+				continue;
+			}
+			if(status == 416 && sink.offset)
+			{
+				// the partial file does not fit the resource any more, start over
+				if(!restart_file(&sink))
+				{
+					break;
+				}
+			}
+			else if(refused || (res == CURLE_WRITE_ERROR && sink.checked && !sink.server_error))
+			{
+				// refused by the server or by the file, asking again will not help
+				break;
+			}
+			
+			// a blip, ask again for the rest, giving up only when attempts stop making progress
+			stalled = sink.position > sink.offset ? 0 : stalled + 1;
+			if(stalled > options->max_retries)
+			{
+				break;
+			}
+			if(stalled)
+			{
+				// back off before asking a failing server again, doubling up to a few seconds
+				std::this_thread::sleep_for(std::chrono::milliseconds(100) * (1 << std::min<std::size_t>(stalled - 1, 5)));
+			}
+		}
+		
+		bool saved = res == CURLE_OK && status < 400 && sink.file && sink.position && (!state.total || sink.position == state.total);
+		if(saved && options->sync_on_close)
+		{
+			saved = sync_file(sink.file);
+		}
+		else if(!saved && sink.file && !refused && sync_file(sink.file))
+		{
+			// record how far it got, so the next attempt resumes from here even in another process
+			state.offset = sink.position;
+			state.save(meta);
+		}
+		if(sink.file && fclose(sink.file) != 0)
+		{
+			saved = false;
+		}
+		if(saved && publish(partial, filename, options->sync_on_close))
+		{
+			remove(meta.c_str());
+			return true;
+		}
+		
+		// keep what arrived for the next attempt, unless the server says there is nothing to resume
+		if(refused || !sink.position)
+		{
+			remove(partial.c_str());
+			remove(meta.c_str());
+		}
+		return false;
+	}
+	
+	public:
+	
+	struct batch_options
+	{
+		std::size_t max_in_flight = 64;
+		std::vector<std::string> headers;
+		
+		// when set, every response buffer of the batch comes from it, so it must outlive the results
+		std::pmr::memory_resource * resource = nullptr;
+	};
+	
+	struct batch_item
+	{
+		std::size_t index = 0;
+		std::string url;
+		package response;
+		CURLcode code = CURLE_OK;
+		std::string error;
+		
+		bool ok() const
+		{
+			return code == CURLE_OK;
+		}
+	};
+	
+	struct prewarm_host
+	{
+		std::string url;
+		bool warmed = false;
+		std::string error;
+		double resolve_seconds = 0;
+		double connect_seconds = 0;
+		double tls_seconds = 0;
+		double total_seconds = 0;
+	};
+	
+	struct prewarm_report
+	{
+		std::size_t warmed = 0;
+		std::vector<prewarm_host> hosts;
+	};
+	
+	private:
+	
+	struct transfer
+	{
+		CURL * curl = nullptr;
+		attachments attached;
+		std::string url;
+		std::string payload;
+		package result;
+		CURLcode code = CURLE_FAILED_INIT;
+		char error[CURL_ERROR_SIZE] = {};
+		
+		// called on the event thread once the transfer is over, while the handle is still valid
+		std::function<void(transfer &)> done;
+	};
+	
+	// a single background thread drives every asynchronous transfer through the multi interface
+	struct engine
+	{
+		minicurl * owner = nullptr;
+		CURLM * multi = nullptr;
+		std::thread worker;
+		std::once_flag started;
+		std::mutex mutex;
+		std::vector<transfer *> pending;
+		std::unordered_set<transfer *> active;
+		bool stopping = false;
+		std::shared_ptr<const config> applied;
+		bool armed = false;
+		std::chrono::steady_clock::time_point deadline;
+#ifndef WINDOWS
+		int epoll_fd = -1;
+		int wake_fd = -1;
+		
+		static int socket_function(CURL *, curl_socket_t socket, int what, void * userp, void * socketp)
+		{
+			engine * self = (engine *) userp;
+			if(what == CURL_POLL_REMOVE)
+			{
+				epoll_ctl(self->epoll_fd, EPOLL_CTL_DEL, socket, nullptr);
+			}
+			else
+			{
+				epoll_event event = {};
+				event.data.fd = socket;
+				event.events = ((what & CURL_POLL_IN) ? static_cast<std::uint32_t>(EPOLLIN) : 0u) | ((what & CURL_POLL_OUT) ? static_cast<std::uint32_t>(EPOLLOUT) : 0u);
+				
+				// libcurl forgets the socket pointer on removal, so a null one means the socket is not registered yet
+				int operation = socketp ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+				if(epoll_ctl(self->epoll_fd, operation, socket, &event) != 0)
+				{
+					operation = (errno == ENOENT) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+					epoll_ctl(self->epoll_fd, operation, socket, &event);
+				}
+				curl_multi_assign(self->multi, socket, self);
+			}
+			return 0;
+		}
+		
+		static int timer_function(CURLM *, long timeout_ms, void * userp)
+		{
+			engine * self = (engine *) userp;
+			self->armed = timeout_ms >= 0;
+			self->deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+			return 0;
+		}
+		
+		int wait_time() const
+		{
+			if(!armed)
+			{
+				return -1;
+			}
+			auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+			return remaining > 0 ? (int) remaining : 0;
+		}
+#endif
+		
+		void start()
+		{
+			std::call_once(started, [this]
+			{
+				multi = curl_multi_init();
+#ifndef WINDOWS
+				epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+				wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+				epoll_event event = {};
+				event.events = EPOLLIN;
+				event.data.fd = wake_fd;
+				epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event);
+				curl_multi_setopt(multi, CURLMOPT_SOCKETFUNCTION, socket_function);
+				curl_multi_setopt(multi, CURLMOPT_SOCKETDATA, this);
+				curl_multi_setopt(multi, CURLMOPT_TIMERFUNCTION, timer_function);
+				curl_multi_setopt(multi, CURLMOPT_TIMERDATA, this);
+#endif
+				worker = std::thread([this] { run(); });
+			});
+		}
+		
+		void wake()
+		{
+#ifndef WINDOWS
+			uint64_t one = 1;
+			if(write(wake_fd, &one, sizeof(one)) < 0)
+			{
+				// the counter is already non-zero, the event thread will wake up anyway
+			}
+#endif
+		}
+		
+		void submit(transfer * t)
+		{
+			start();
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				pending.push_back(t);
+			}
+			wake();
+		}
+		
+		// hand the handles submitted by other threads over to the multi handle
+		bool adopt()
+		{
+			std::vector<transfer *> incoming;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if(stopping)
+				{
+					return false;
+				}
+				incoming.swap(pending);
+			}
+			// multi options may only be changed from the thread driving the multi handle
+			std::shared_ptr<const config> options = owner->current();
+			if(options != applied)
+			{
+				curl_multi_setopt(multi, CURLMOPT_PIPELINING, options->multiplex ? CURLPIPE_MULTIPLEX : CURLPIPE_NOTHING);
+				curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, options->max_host_connections);
+				curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, options->max_total_connections);
+				applied = options;
+			}
+			for(transfer * t : incoming)
+			{
+				curl_easy_setopt(t->curl, CURLOPT_PRIVATE, t);
+				if(curl_multi_add_handle(multi, t->curl) == CURLM_OK)
+				{
+					active.insert(t);
+				}
+				else
+				{
+					owner->finish(t);
+				}
+			}
+			return true;
+		}
+		
+		void collect()
+		{
+			int queued = 0;
+			while(CURLMsg * message = curl_multi_info_read(multi, &queued))
+			{
+				if(message->msg == CURLMSG_DONE)
+				{
+					transfer * t = nullptr;
+					curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, (char **) &t);
+					t->code = message->data.result;
+					curl_multi_remove_handle(multi, t->curl);
+					active.erase(t);
+					owner->finish(t);
+				}
+			}
+		}
+		
+		void run()
+		{
+			int running = 0;
+			while(adopt())
+			{
+#ifndef WINDOWS
+				epoll_event events[64];
+				int count = epoll_wait(epoll_fd, events, 64, wait_time());
+				for(int i = 0; i < count; ++i)
+				{
+					if(events[i].data.fd == wake_fd)
+					{
+						uint64_t value = 0;
+						if(read(wake_fd, &value, sizeof(value)) < 0)
+						{
+							// spurious wake up, nothing to drain
+						}
+					}
+					else
+					{
+						int flags = 0;
+						flags |= (events[i].events & EPOLLIN) ? CURL_CSELECT_IN : 0;
+						flags |= (events[i].events & EPOLLOUT) ? CURL_CSELECT_OUT : 0;
+						flags |= (events[i].events & (EPOLLERR | EPOLLHUP)) ? CURL_CSELECT_ERR : 0;
+						curl_multi_socket_action(multi, events[i].data.fd, flags, &running);
+					}
+				}
+				if(armed && wait_time() == 0)
+				{
+					armed = false;
+					curl_multi_socket_action(multi, CURL_SOCKET_TIMEOUT, 0, &running);
+				}
+#else
+				curl_multi_perform(multi, &running);
+				curl_multi_wait(multi, nullptr, 0, 100, nullptr);
+#endif
+				collect();
+			}
+		}
+		
+		void stop()
+		{
+			if(worker.joinable())
+			{
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					stopping = true;
+				}
+				wake();
+				worker.join();
+				
+				// whatever did not complete is reported as aborted
+				for(transfer * t : active)
+				{
+					curl_multi_remove_handle(multi, t->curl);
+					t->code = CURLE_ABORTED_BY_CALLBACK;
+					owner->finish(t);
+				}
+				active.clear();
+				for(transfer * t : pending)
+				{
+					t->code = CURLE_ABORTED_BY_CALLBACK;
+					owner->finish(t);
+				}
+				pending.clear();
+			}
+			if(multi)
+			{
+				curl_multi_cleanup(multi);
+				multi = nullptr;
+			}
+#ifndef WINDOWS
+			if(wake_fd >= 0)
+			{
+				close(wake_fd);
+				wake_fd = -1;
+			}
+			if(epoll_fd >= 0)
+			{
+				close(epoll_fd);
+				epoll_fd = -1;
+			}
+#endif
+		}
+	};
+	
+	engine async;
+	
+	// report the outcome of an asynchronous transfer and give its handle back to the pool
+	void finish(transfer * t)
+	{
+		if(t->curl && t->code == CURLE_OK)
+		{
+			long status_code = 0;
+			curl_easy_getinfo(t->curl, CURLINFO_RESPONSE_CODE, &status_code);
+			t->result.status = static_cast<std::size_t>(status_code);
+		}
+		t->result.content.seal();
+		if(t->done)
+		{
+			t->done(*t);
+		}
+		handles.checkin(t->curl);
+		delete t;
+	}
+	
+	transfer * make_transfer(std::string const & url, std::string const & payload, std::vector<std::string> const & headers, std::function<void(transfer &)> done, std::pmr::memory_resource * resource = nullptr)
+	{
+		std::shared_ptr<const config> options = current();
+		transfer * t = new transfer();
+		if(resource)
+		{
+			t->result = package(resource);
+		}
+		t->result.content.limit = options->memory_limit;
+		t->url = url;
+		t->payload = payload;
+		t->done = std::move(done);
+		if(url.size() && (t->curl = checkout(*options)))
+		{
+			curl_easy_setopt(t->curl, CURLOPT_WRITEFUNCTION, write_function);
+			curl_easy_setopt(t->curl, CURLOPT_WRITEDATA, (void *) &t->result.content);
+			curl_easy_setopt(t->curl, CURLOPT_ERRORBUFFER, t->error);
+			prepare(t->curl, *options, t->url, t->payload, headers, t->result, t->attached);
+		}
+		return t;
+	}
+	
+	void launch(transfer * t)
+	{
+		if(t->curl)
+		{
+			async.submit(t);
+		}
+		else
+		{
+			finish(t);
+		}
+	}
+	
+	void fetch_async(std::string const & url, std::string const & payload, std::vector<std::string> const & headers, std::function<void(transfer &)> done, std::pmr::memory_resource * resource = nullptr)
+	{
+		launch(make_transfer(url, payload, headers, std::move(done), resource));
+	}
+	
+	std::future<package> fetch_future(std::string const & url, std::string const & payload, std::vector<std::string> const & headers)
+	{
+		auto promise = std::make_shared<std::promise<package>>();
+		std::future<package> future = promise->get_future();
+		fetch_async(url, payload, headers, [promise](transfer & t)
+		{
+			promise->set_value(std::move(t.result));
+		});
+		return future;
+	}
+	
+	// a bodiless request resolves the host, connects and completes the tls handshake, leaving all of it in the shared caches
+	prewarm_report warm(std::vector<std::string> const & origins)
+	{
+		prewarm_report report;
+		report.hosts.resize(origins.size());
+		std::mutex mutex;
+		std::condition_variable ready;
+		std::size_t remaining = origins.size();
+		
+		for(std::size_t i = 0; i < origins.size(); ++i)
+		{
+			transfer * t = make_transfer(origins[i], "", {}, [&, i](transfer & t)
+			{
+				prewarm_host & host = report.hosts[i];
+				host.url = t.url;
+				host.warmed = (t.code == CURLE_OK);
+				if(host.warmed)
+				{
+					double resolved = 0, connected = 0, secured = 0, total = 0;
+					curl_easy_getinfo(t.curl, CURLINFO_NAMELOOKUP_TIME, &resolved);
+					curl_easy_getinfo(t.curl, CURLINFO_CONNECT_TIME, &connected);
+					curl_easy_getinfo(t.curl, CURLINFO_APPCONNECT_TIME, &secured);
+					curl_easy_getinfo(t.curl, CURLINFO_TOTAL_TIME, &total);
+					host.resolve_seconds = resolved;
+					host.connect_seconds = connected > resolved ? connected - resolved : 0;
+					host.tls_seconds = secured > connected ? secured - connected : 0;
+					host.total_seconds = total;
+				}
+				else
+				{
+					host.error = t.error[0] ? t.error : curl_easy_strerror(t.code);
+				}
+				std::lock_guard<std::mutex> guard(mutex);
+				--remaining;
+				ready.notify_one();
+			});
+			if(t->curl)
+			{
+				curl_easy_setopt(t->curl, CURLOPT_NOBODY, 1L);
+			}
+			launch(t);
+		}
+		
+		std::unique_lock<std::mutex> lock(mutex);
+		ready.wait(lock, [&] { return remaining == 0; });
+		for(prewarm_host const & host : report.hosts)
+		{
+			report.warmed += host.warmed ? 1 : 0;
+		}
+		return report;
+	}
+	
+	// the event thread fills bodies while the calling thread prepares requests, so a batch resource is only used under a lock
+	struct locked_resource : std::pmr::memory_resource
+	{
+		std::pmr::memory_resource * upstream;
+		std::mutex mutex;
+		
+		explicit locked_resource(std::pmr::memory_resource * r) : upstream(r)
+		{
+		}
+		
+		void * do_allocate(std::size_t bytes, std::size_t alignment) override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return upstream->allocate(bytes, alignment);
+		}
+		
+		void do_deallocate(void * p, std::size_t bytes, std::size_t alignment) override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			upstream->deallocate(p, bytes, alignment);
+		}
+		
+		bool do_is_equal(std::pmr::memory_resource const & other) const noexcept override
+		{
+			return this == &other;
+		}
+	};
+	
+	// keep at most max_in_flight transfers on the event thread and hand every result to the calling thread as it completes
+	void fetch_many(std::vector<std::string> const & urls, batch_options const & options, std::function<void(batch_item &)> const & on_complete)
+	{
+		std::mutex mutex;
+		std::condition_variable ready;
+		std::vector<batch_item> completed;
+		std::size_t const limit = options.max_in_flight ? options.max_in_flight : 1;
+		std::size_t next = 0;
+		std::size_t in_flight = 0;
+		std::size_t done = 0;
+		
+		std::unique_ptr<locked_resource> resource;
+		if(options.resource)
+		{
+			resource.reset(new locked_resource(options.resource));
+		}
+		
+		std::unique_lock<std::mutex> lock(mutex);
+		try
+		{
+			while(done < urls.size())
+			{
+				while(in_flight < limit && next < urls.size())
+				{
+					std::size_t index = next++;
+					++in_flight;
+					lock.unlock();
+					try
+					{
+						fetch_async(urls[index], "", options.headers, [&, index](transfer & t)
+						{
+							batch_item item;
+							item.index = index;
+							item.url = t.url;
+							item.code = t.code;
+							if(t.code != CURLE_OK)
+							{
+								item.error = t.error[0] ? t.error : curl_easy_strerror(t.code);
+							}
+							item.response = std::move(t.result);
+							std::lock_guard<std::mutex> guard(mutex);
+							completed.push_back(std::move(item));
+							ready.notify_one();
+						}, resource.get());
+					}
+					catch(...)
+					{
+						lock.lock();
+						--in_flight;
+						throw;
+					}
+					lock.lock();
+				}
+				
+				ready.wait(lock, [&] { return !completed.empty(); });
+				std::vector<batch_item> batch;
+				batch.swap(completed);
+				in_flight -= batch.size();
+				done += batch.size();
+				
+				lock.unlock();
+				for(batch_item & item : batch)
+				{
+					// the buffers were allocated from the caller's resource, the lock is only needed while transfers run
+					for(chunk * buffer : {&item.response.header, &item.response.content})
+					{
+						if(resource && buffer->resource == resource.get())
+						{
+							buffer->resource = options.resource;
+						}
+					}
+					on_complete(item);
+				}
+				lock.lock();
+			}
+		}
+		catch(...)
+		{
+			// transfers still running write into this frame and allocate from its resource, let them finish before it unwinds
+			if(!lock.owns_lock())
+			{
+				lock.lock();
+			}
+			ready.wait(lock, [&] { return completed.size() == in_flight; });
+			completed.clear();
+			throw;
+		}
+	}
+	
+#ifndef WINDOWS
+	// segments are never split below this, smaller files are not worth more than one connection
+	static constexpr std::size_t minimum_segment = std::size_t(1) << 20;
+	
+	// ask for the first byte, a partial response carrying the full length proves the server can serve segments
+	std::size_t probe_ranges(std::string const & url, std::vector<std::string> const & headers, std::string & validator)
+	{
+		std::shared_ptr<const config> options = current();
+		CURL * curl = checkout(*options);
+		if(!curl)
+		{
+			return 0;
+		}
+		package response;
+		attachments attached;
+		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_function);
+		curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *) &response.content);
+		prepare(curl, *options, url, "", headers, response, attached);
+		curl_easy_setopt(curl, CURLOPT_RANGE, "0-0");
+		
+		CURLcode res = curl_easy_perform(curl);
+		long status_code = 0;
+		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status_code);
+		handles.checkin(curl);
+		
+		std::size_t first = 0;
+		std::size_t last = 0;
+		std::size_t total = 0;
+		if(res != CURLE_OK || status_code != 206 || !response.content_range(first, last, total) || first != 0)
+		{
+			return 0;
+		}
+		// If-Range only takes strong validators, a weak etag would make every segment get the whole file
+		validator = validator_of(response);
+		return total;
+	}
+	
+	static bool write_at(int fd, char const * buffer, std::size_t length, std::size_t offset)
+	{
+		while(length)
+		{
+			ssize_t written = pwrite(fd, buffer, length, static_cast<off_t>(offset));
+			if(written < 0)
+			{
+				if(errno == EINTR)
+				{
+					continue;
+				}
+				return false;
+			}
+			buffer += written;
+			offset += static_cast<std::size_t>(written);
+			length -= static_cast<std::size_t>(written);
 		}
-
-		return DebugInfoSize;
+		return true;
 	}
 	
-	static size_t write_function(void * buffer, std::size_t size, std::size_t count, void * stream)
+	// one attempt at the byte range [offset, end) of the file
+	struct segment_state
+	{
+		int fd = -1;
+		std::size_t offset = 0;
+		std::size_t end = 0;
+		std::size_t written = 0;
+		package * response = nullptr;
+		bool checked = false;
+		
+		// what the probe saw, a segment of any other version must not end up in the file
+		std::string const * validator = nullptr;
+		std::size_t size = 0;
+		bool changed = false;
+	};
+	
+	// write a block at its place in the file, refusing anything but the range that was asked for
+	static size_t segment_function(void * buffer, std::size_t size, std::size_t count, void * stream)
 	{
 		std::size_t realsize = size * count;
-		chunk * memory = (chunk *) stream;
-		char * aux = (char *) realloc(memory->data, memory->size + realsize);
-		if(aux)
+		segment_state * state = (segment_state *) stream;
+		if(!state->checked)
 		{
-			// save stream as is without adding the null terminator
-			memory->data = aux;
-			memcpy(memory->data + memory->size, buffer, realsize);
-			memory->size += realsize;
+			std::size_t first = 0;
+			std::size_t last = 0;
+			std::size_t total = 0;
+			if(!state->response->content_range(first, last, total) || first != state->offset || last + 1 != state->end)
+			{
+				return 0;
+			}
+			std::string validator = validator_of(*state->response);
+			if((total && total != state->size) || (validator.size() && state->validator->size() && validator != *state->validator))
+			{
+				// a server ignoring If-Range sent a range of a newer version
+				state->changed = true;
+				return 0;
+			}
+			state->checked = true;
 		}
-		else
+		std::size_t position = state->offset + state->written;
+		if(position + realsize > state->end || !write_at(state->fd, (char const *) buffer, realsize, position))
 		{
-			realsize = 0;
+			return 0;
 		}
+		state->written += realsize;
 		return realsize;
 	}
 	
-	// trim from start (in place)
-	static inline void ltrim(std::string &s) 
+	// fetch the file as byte ranges on several connections at once, each written straight to its offset
+	bool fetch_segmented(std::string const & url, std::string const & filename, std::vector<std::string> const & headers, std::size_t size, std::string const & validator, std::size_t max_segments)
 	{
-		s.erase(s.begin(), std::find_if(s.begin(), s.end(), [](int ch) 
+		std::string partial = filename + ".part";
+		int fd = open(partial.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if(fd < 0)
 		{
-			return !std::isspace(ch) && ch != '\r' && ch != '\n';
-		}));
-	}
-
-	// trim from end (in place)
-	static inline void rtrim(std::string &s) 
-	{
-		s.erase(std::find_if(s.rbegin(), s.rend(), [](int ch) 
+			return false;
+		}
+		
+		// reserve the blocks up front so concurrent writers do not fragment the file, file systems that cannot are just extended
+		if(posix_fallocate(fd, 0, static_cast<off_t>(size)) != 0 && ftruncate(fd, static_cast<off_t>(size)) != 0)
 		{
-			return !std::isspace(ch) && ch != '\r' && ch != '\n';
-		}).base(), s.end());
-	}
-
-	// trim from both ends (in place)
-	static inline void trim(std::string &s) 
-	{
-		ltrim(s);
-		rtrim(s);
-	}
-
-	static std::size_t get_content_length(const std::string& header)
-	{
-		std::string key, val;
-		std::istringstream iss(header);
-
-		while (std::getline(std::getline(iss, key, ':') >> std::ws, val))
+			close(fd);
+			remove(partial.c_str());
+			return false;
+		}
+		
+		// a changed file makes the server answer with all of it, which the segments refuse
+		std::vector<std::string> range_headers(headers);
+		if(validator.size())
 		{
-			trim(val);
-			if (key == "Content-Length")
-			{
-				return atol(val.c_str());
-			}
+			range_headers.push_back("If-Range: " + validator);
 		}
-
-		return 0;
-	}
-	
-	package fetch(std::string const & url, std::string const & payload, std::string const & filename, bool save_to_disk, std::vector<std::string> const & headers)
-	{
-		std::size_t status = 0;
-		chunk header;
-		chunk content;
 		
-		if(url.size())
+		// many more pieces than connections, so the number of connections can change while the download runs
+		max_segments = std::max<std::size_t>(max_segments, 1);
+		std::size_t piece = std::max(minimum_segment, size / (max_segments * 4));
+		std::vector<std::pair<std::size_t, std::size_t>> pending;
+		for(std::size_t offset = size; offset > 0;)
 		{
-			CURL * curl = curl_easy_init();
-			if(curl)
+			std::size_t end = offset;
+			offset = offset > piece ? offset - piece : 0;
+			pending.emplace_back(offset, end);
+		}
+		
+		std::mutex mutex;
+		std::condition_variable finished;
+		std::size_t in_flight = 0;
+		std::size_t completed = 0;
+		std::size_t received = 0;
+		std::size_t stalled = 0;
+		std::size_t const max_stalled = 3;
+		bool changed = false;
+		
+		auto launch_segment = [&](std::size_t offset, std::size_t end)
+		{
+			std::shared_ptr<segment_state> state = std::make_shared<segment_state>();
+			state->fd = fd;
+			state->offset = offset;
+			state->end = end;
+			state->validator = &validator;
+			state->size = size;
+			transfer * t = make_transfer(url, "", range_headers, [&, state](transfer &)
 			{
-				// download file handle, if we are saving directly to disk
-				FILE * save_file = nullptr;
-
-				// upload file handle
-				FILE * upload_file = nullptr;
-
-				// make read timeout small because we are supporting retries
-				curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, 1000);
-
-				// save large files directly to disk
-				if (save_to_disk)
-				{
-					if (filename.size() && (save_file = fopen(filename.c_str(), "ab")))
-					{
-						// write curl response to file
-						curl_easy_setopt(curl, CURLOPT_FILE, save_file);
-						curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, true);
-					}
-				}
-				else
-				{
-					curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_function);
-					curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&content);
-				}
-
-				curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, write_function);
-				curl_easy_setopt(curl, CURLOPT_HEADERDATA, (void *) &header);
-
-				// Always setup the debug function to allow for activity to be tracked
-				curl_easy_setopt(curl, CURLOPT_DEBUGDATA, this);
-				curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, debug_function);
-				curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
-				
-				if(payload.size())
-				{
-					curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payload.c_str());
-				}
-				
-				if (!save_to_disk)
-				{
-					if (filename.size() && (upload_file = fopen(filename.c_str(), "rb")))
-					{
-						struct stat file_stat;
-						if (fstat(fileno(upload_file), &file_stat) == 0)
-						{
-							curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
-							curl_easy_setopt(curl, CURLOPT_READDATA, upload_file);
-							curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE, file_stat.st_size);
-						}
-					}
-				}
-				
-				bool bHasContentLength = false;
-				struct curl_slist * header_list = nullptr;
-				for(std::string h : headers)
+				std::lock_guard<std::mutex> lock(mutex);
+				received += state->written;
+				if(state->changed)
 				{
-					if(h.size())
-					{
-						auto tokens = split(h, ":");
-						if((tokens.size() == 1 || (tokens.size() == 2 && tokens[1].empty())) && tokens[0].back() != ';')
-						{
-							if (tokens.front() == "Content-Length")
-								bHasContentLength = true;
-
-							h = tokens.front() + ";";
-						}
-						header_list = curl_slist_append(header_list, h.c_str());
-					}
+					changed = true;
 				}
-
-				// content-length should be present http://www.w3.org/Protocols/rfc2616/rfc2616-sec4.html#sec4.4
-				if (bHasContentLength)
-					header_list = curl_slist_append(header_list, "Content-Length: -1");
-
-				curl_easy_setopt(curl, CURLOPT_HTTPHEADER, header_list);
-				
-				curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-				curl_easy_setopt(curl, CURLOPT_USERAGENT, "libcurl-agent/1.0");
-				curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-
-				CURLcode res = curl_easy_perform(curl);
-				while (res = CURLE_PARTIAL_FILE)
+				else if(state->offset + state->written < state->end)
 				{
-					std::size_t max_length = get_content_length(header.to_string());
-					std::size_t file_size;
-
-					if (save_to_disk)
-					{
-						fflush(save_file);
-
-						// get the number of bytes written and try again
-						fseek(save_file, 0L, SEEK_END);
-						file_size = ftell(save_file);
-					}
-					else
-					{
-						file_size = content.size;
-					}
-					
-					if (max_length <= file_size)
-					{
-						res = CURLE_OK;
-						break;
-					}
-					curl_easy_setopt(curl, CURLOPT_RESUME_FROM, file_size);
-					res = curl_easy_perform(curl);
+					// keep what arrived and ask again for the rest, giving up only when attempts stop making progress
+					stalled = state->written ? 0 : stalled + 1;
+					pending.emplace_back(state->offset + state->written, state->end);
 				}
-				
-				if(res == CURLE_OK)
+				++completed;
+				--in_flight;
+				finished.notify_one();
+			});
+			state->response = &t->result;
+			if(t->curl)
+			{
+				std::string range = std::to_string(offset) + "-" + std::to_string(end - 1);
+				curl_easy_setopt(t->curl, CURLOPT_WRITEFUNCTION, segment_function);
+				curl_easy_setopt(t->curl, CURLOPT_WRITEDATA, (void *) state.get());
+				curl_easy_setopt(t->curl, CURLOPT_RANGE, range.c_str());
+			}
+			launch(t);
+		};
+		
+		// like tcp slow start, add a connection while it still raises the throughput and drop one when it hurts
+		std::size_t target = std::min<std::size_t>(2, max_segments);
+		std::size_t measured_at = 0;
+		std::size_t measured_bytes = 0;
+		double measured_rate = 0;
+		auto measured_time = std::chrono::steady_clock::now();
+		
+		std::unique_lock<std::mutex> lock(mutex);
+		while(true)
+		{
+			while(in_flight < target && !pending.empty() && stalled < max_stalled && !changed)
+			{
+				std::pair<std::size_t, std::size_t> next = pending.back();
+				pending.pop_back();
+				++in_flight;
+				lock.unlock();
+				try
 				{
-					long status_code = 0;
-					curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status_code);
-					status = static_cast<std::size_t>(status_code);
+					launch_segment(next.first, next.second);
 				}
-				
-				if(save_file)
+				catch(...)
 				{
-					fclose(save_file);
+					// segments already handed over still write through this frame, so let them finish first
+					lock.lock();
+					--in_flight;
+					finished.wait(lock, [&] { return in_flight == 0; });
+					close(fd);
+					remove(partial.c_str());
+					throw;
 				}
-
-				if (upload_file)
+				lock.lock();
+			}
+			
+			// callbacks refer to this frame, so wait for every segment even after giving up
+			if(in_flight == 0)
+			{
+				break;
+			}
+			finished.wait(lock);
+			
+			if(completed - measured_at >= target)
+			{
+				auto now = std::chrono::steady_clock::now();
+				double seconds = std::chrono::duration<double>(now - measured_time).count();
+				double rate = seconds > 0 ? (received - measured_bytes) / seconds : 0;
+				if(rate > measured_rate * 1.1 && target < max_segments)
 				{
-					fclose(upload_file);
+					++target;
 				}
-
-				if(header_list)
+				else if(rate < measured_rate * 0.9 && target > 1)
 				{
-					curl_slist_free_all(header_list);
+					--target;
 				}
-				curl_easy_cleanup(curl);
+				measured_at = completed;
+				measured_bytes = received;
+				measured_rate = rate;
+				measured_time = now;
 			}
 		}
 		
-		return package(status, header, content);
+		// segments do not record their progress, so an incomplete file cannot be resumed
+		bool durable = current()->sync_on_close;
+		bool saved = pending.empty() && stalled < max_stalled && !changed && (!durable || fdatasync(fd) == 0);
+		if(close(fd) != 0)
+		{
+			saved = false;
+		}
+		if(saved && publish(partial, filename, durable))
+		{
+			return true;
+		}
+		remove(partial.c_str());
+		return false;
 	}
+#endif
 	
-	minicurl()
+	minicurl(config const & options)
 	{
-		curl_global_init(CURL_GLOBAL_ALL);
+		allocator const & hooks = options.library_allocator;
+		if(hooks.complete())
+		{
+			curl_global_init_mem(CURL_GLOBAL_ALL, hooks.malloc_function, hooks.free_function, hooks.realloc_function, hooks.strdup_function, hooks.calloc_function);
+		}
+		else
+		{
+			curl_global_init(CURL_GLOBAL_ALL);
+		}
+		shared.init();
+		settings.store(std::make_shared<const config>(options));
+		buffer_pool::instance().limit = options.max_pooled_bytes;
+		async.owner = this;
 	}
 	
 	public:
 	
 	~minicurl()
 	{
+		async.stop();
+		handles.clear();
+		shared.cleanup();
 		curl_global_cleanup();
 	}
 	
@@ -574,24 +3284,284 @@ class minicurl
 	minicurl(minicurl &&) = delete;
 	minicurl & operator=(minicurl) = delete;
 	
+	// runs curl_global_init, which is not thread-safe, so call it from main before starting any other thread
+	static void init()
+	{
+		get_singleton();
+	}
+	
+	static void init(config const & options)
+	{
+		initial_settings() = options;
+		configure(options);
+	}
+	
+	// requests already in flight keep the settings they started with
+	static void configure(config const & options)
+	{
+		get_singleton().settings.store(std::make_shared<const config>(options));
+		buffer_pool::instance().limit = options.max_pooled_bytes;
+	}
+	
+	static config get_config()
+	{
+		return *get_singleton().current();
+	}
+	
+	// pin host:port to an address for every following request, bypassing the resolver
+	static void add_resolve(std::string const & host, int port, std::string const & address)
+	{
+		std::string key = host + ":" + std::to_string(port);
+		get_singleton().update_routes([&](route_table & table)
+		{
+			table.resolve[key] = address;
+			table.removed.erase(std::remove(table.removed.begin(), table.removed.end(), key), table.removed.end());
+		});
+	}
+	
+	static void remove_resolve(std::string const & host, int port)
+	{
+		std::string key = host + ":" + std::to_string(port);
+		get_singleton().update_routes([&](route_table & table)
+		{
+			if(table.resolve.erase(key))
+			{
+				table.removed.push_back(key);
+			}
+		});
+	}
+	
+	// connect to target_host:target_port whenever a request is addressed to host:port
+	static void add_connect_to(std::string const & host, int port, std::string const & target_host, int target_port)
+	{
+		std::string key = host + ":" + std::to_string(port);
+		std::string target = target_host + ":" + std::to_string(target_port);
+		get_singleton().update_routes([&](route_table & table)
+		{
+			table.connect_to[key] = target;
+		});
+	}
+	
+	static void remove_connect_to(std::string const & host, int port)
+	{
+		std::string key = host + ":" + std::to_string(port);
+		get_singleton().update_routes([&](route_table & table)
+		{
+			table.connect_to.erase(key);
+		});
+	}
+	
+	struct pool_stats
+	{
+		std::size_t reused = 0;
+		std::size_t missed = 0;
+		std::size_t evicted = 0;
+		std::size_t idle = 0;
+	};
+	
+	static pool_stats get_pool_stats()
+	{
+		handle_pool & pool = get_singleton().handles;
+		pool_stats stats;
+		stats.reused = pool.reused;
+		stats.missed = pool.missed;
+		stats.evicted = pool.evicted;
+		std::lock_guard<std::mutex> lock(pool.mutex);
+		stats.idle = pool.idle.size();
+		return stats;
+	}
+	
+	struct buffer_stats
+	{
+		std::size_t hits = 0;
+		std::size_t misses = 0;
+		std::size_t retained_bytes = 0;
+		
+		double hit_rate() const
+		{
+			return (hits + misses) ? double(hits) / double(hits + misses) : 0.0;
+		}
+	};
+	
+	static buffer_stats get_buffer_stats()
+	{
+		buffer_pool & pool = buffer_pool::instance();
+		buffer_stats stats;
+		stats.hits = pool.hits;
+		stats.misses = pool.misses;
+		stats.retained_bytes = pool.retained;
+		return stats;
+	}
+	
+	// install with config::library_allocator to account for the memory libcurl allocates internally
+	static allocator counting_allocator()
+	{
+		allocator hooks;
+		hooks.malloc_function = counting::allocate;
+		hooks.free_function = counting::release;
+		hooks.realloc_function = counting::resize;
+		hooks.strdup_function = counting::duplicate;
+		hooks.calloc_function = counting::zeroed;
+		return hooks;
+	}
+	
+	struct library_stats
+	{
+		std::size_t allocations = 0;
+		std::size_t allocated_bytes = 0;
+		std::size_t live_bytes = 0;
+	};
+	
+	static library_stats get_library_stats()
+	{
+		library_stats stats;
+		stats.allocations = counting::allocations();
+		stats.allocated_bytes = counting::allocated();
+		stats.live_bytes = counting::live();
+		return stats;
+	}
+	
+	// best effort, counted from libcurl's verbose messages, so a release that rewords or drops one stops counting it
+	struct share_stats
+	{
+		std::size_t dns_hits = 0;
+		std::size_t tls_resumptions = 0;
+		std::size_t connections_reused = 0;
+	};
+	
+	static share_stats get_share_stats()
+	{
+		share & cache = get_singleton().shared;
+		share_stats stats;
+		stats.dns_hits = cache.dns_hits;
+		stats.tls_resumptions = cache.tls_resumptions;
+		stats.connections_reused = cache.connections_reused;
+		return stats;
+	}
+	
 	static std::string get(std::string const & url, std::vector<std::string> const & headers = {})
 	{
-		return get_singleton().fetch(url, "", "", false, headers).content.to_string();
+		return get_singleton().fetch(url, "", "", headers).content.to_string();
+	}
+	
+	// reuse the capacity of the caller's buffer across calls, the status is 0 if the transfer failed
+	static fill_result get(std::string const & url, std::string & body, std::vector<std::string> const & headers = {})
+	{
+		return get_singleton().fetch_into(url, body, headers);
+	}
+	
+	static fill_result get(std::string const & url, std::vector<char> & body, std::vector<std::string> const & headers = {})
+	{
+		return get_singleton().fetch_into(url, body, headers);
+	}
+	
+	// never writes past capacity, a body that does not fit aborts the transfer and is reported as truncated
+	static fill_result get(std::string const & url, char * buffer, std::size_t capacity, std::vector<std::string> const & headers = {})
+	{
+		fixed_buffer body = {buffer, capacity, 0, false};
+		std::size_t status = 0;
+		CURLcode res = get_singleton().fetch_to(url, headers, fixed_function, &body, status);
+		fill_result result;
+		result.status = (res == CURLE_OK || body.truncated) ? status : 0;
+		result.size = body.size;
+		result.truncated = body.truncated;
+		return result;
+	}
+	
+	// hand each block of the body to on_chunk as it arrives, pausing stops reading the socket until libcurl offers the block again
+	// a paused transfer resumes once ready returns true, without it the block is offered again almost at once
+	// the transfer timeout keeps running while paused, an exception thrown by on_chunk or ready aborts the transfer and is rethrown here
+	static std::size_t get_stream(std::string const & url, std::function<stream_action(std::string_view)> const & on_chunk, std::vector<std::string> const & headers = {}, std::function<bool()> const & ready = nullptr)
+	{
+		return get_singleton().fetch_stream(url, on_chunk, headers, ready);
+	}
+	
+	// the whole response, moved from the transfer to the caller without copying the body
+	// with a memory resource, the response buffers and the request headers are allocated from it
+	// a body past the memory limit, zero meaning config::memory_limit, comes back as a read-only mapping of a temporary file
+	static package get_response(std::string const & url, std::vector<std::string> const & headers = {}, std::pmr::memory_resource * resource = nullptr, std::size_t memory_limit = 0)
+	{
+		return get_singleton().fetch(url, "", "", headers, resource, memory_limit);
+	}
+	
+	static package post_response(std::string const & url, std::string const & payload, std::vector<std::string> const & headers = {"Content-Type: text/plain"}, std::pmr::memory_resource * resource = nullptr)
+	{
+		return get_singleton().fetch(url, payload, "", headers, resource);
 	}
 	
 	static std::string get_header(std::string const & url, std::vector<std::string> const & headers = {})
 	{
-		return get_singleton().fetch(url, "", "", false, headers).header.to_string();
+		return get_singleton().fetch(url, "", "", headers).header.to_string();
 	}
 	
 	static std::string post(std::string const & url, std::string const & payload, std::vector<std::string> const & headers = {"Content-Type: text/plain"})
 	{
-		return get_singleton().fetch(url, payload, "", false, headers).content.to_string();
+		return get_singleton().fetch(url, payload, "", headers).content.to_string();
+	}
+	
+	// send the following requests over http/2, letting the event thread multiplex transfers to the same host over one connection
+	static void set_multiplexing(bool enabled, bool prior_knowledge = false)
+	{
+		config options = get_config();
+		options.multiplex = enabled;
+		options.prior_knowledge = prior_knowledge;
+		configure(options);
+	}
+	
+	// open connections to the given origins (e.g. "https://example.com") ahead of the first real request
+	// the connections are kept by the event thread for async calls and get_many, blocking calls still skip the lookup and resume the tls session
+	static prewarm_report prewarm(std::vector<std::string> const & origins)
+	{
+		return get_singleton().warm(origins);
+	}
+	
+	// the returned future is fulfilled by the background event thread once the transfer is over
+	static std::future<package> get_async(std::string const & url, std::vector<std::string> const & headers = {})
+	{
+		return get_singleton().fetch_future(url, "", headers);
+	}
+	
+	static std::future<package> post_async(std::string const & url, std::string const & payload, std::vector<std::string> const & headers = {"Content-Type: text/plain"})
+	{
+		return get_singleton().fetch_future(url, payload, headers);
+	}
+	
+	// results in the same order as the urls
+	static std::vector<batch_item> get_many(std::vector<std::string> const & urls)
+	{
+		return get_many(urls, batch_options());
+	}
+	
+	static std::vector<batch_item> get_many(std::vector<std::string> const & urls, batch_options const & options)
+	{
+		// filled as transfers complete rather than with a default package per url up front
+		std::vector<batch_item> results;
+		results.reserve(urls.size());
+		get_singleton().fetch_many(urls, options, [&results](batch_item & item)
+		{
+			results.push_back(std::move(item));
+		});
+		std::sort(results.begin(), results.end(), [](batch_item const & x, batch_item const & y)
+		{
+			return x.index < y.index;
+		});
+		return results;
+	}
+	
+	// results handed to the callback, on the calling thread, in the order they complete
+	static void get_many(std::vector<std::string> const & urls, std::function<void(batch_item &)> const & on_complete)
+	{
+		get_many(urls, on_complete, batch_options());
+	}
+	
+	static void get_many(std::vector<std::string> const & urls, std::function<void(batch_item &)> const & on_complete, batch_options const & options)
+	{
+		get_singleton().fetch_many(urls, options, on_complete);
 	}
 	
 	static std::string upload(std::string const & url, std::string const & filename, std::vector<std::string> const & headers = {"Content-Type: text/plain"})
 	{
-		return get_singleton().fetch(url, "", filename, false, headers).content.to_string();
+		return get_singleton().fetch(url, "", filename, headers).content.to_string();
 	}
 
 	static bool file_exists(const std::string& name) 
@@ -600,57 +3570,54 @@ class minicurl
 		return f.good();
 	}
 	
-	static std::string download(std::string const & url, std::string const & filename = "", bool save_to_disk=false, std::vector<std::string> const & headers = {})
+	// fetch a large file over up to max_segments connections, each writing its own byte range of the preallocated file
+	// the number of connections follows the observed throughput, servers that cannot serve ranges, or segments that keep failing, get a plain download to disk
+	static std::string download_segmented(std::string const & url, std::string const & filename = "", std::vector<std::string> const & headers = {}, std::size_t max_segments = 8)
+	{
+		if(url.empty())
+		{
+			return std::string("");
+		}
+		std::string confirmed_filename = filename.size() ? filename : std::string(split(url, "/").back());
+#ifndef WINDOWS
+		minicurl & self = get_singleton();
+		std::string validator;
+		std::size_t size = self.probe_ranges(url, headers, validator);
+		if(size >= 2 * minimum_segment && max_segments > 1 && self.fetch_segmented(url, confirmed_filename, headers, size, validator, max_segments))
+		{
+			return confirmed_filename;
+		}
+#endif
+		return download(url, confirmed_filename, true, headers);
+	}
+	
+	// the body always goes straight to filename.part, which replaces filename only once complete
+	// save_to_disk is kept for compatibility, a partial file left by an interrupted download is resumed either way
+	static std::string download(std::string const & url, std::string const & filename = "", [[maybe_unused]] bool save_to_disk=false, std::vector<std::string> const & headers = {})
 	{
 		if(url.size())
 		{
-			std::string confirmed_filename;
-			
-			// if saving directly to disk, the filename will be interpreted as the download file location path
-			if (save_to_disk)
-				confirmed_filename = filename.size() ? filename : split(url, "/").back();
+			// the filename will be interpreted as the download file location path
+			std::string confirmed_filename = filename.size() ? filename : std::string(split(url, "/").back());
 
-			// combile url and filename to get the full url path
-			package result = get_singleton().fetch(url, "", confirmed_filename, save_to_disk, headers);
-			if (!result.isValid())
+			std::size_t status = 0;
+			if (get_singleton().fetch_file(url, confirmed_filename, headers, status))
 			{
-				// report errors
-				if (result.isNotFound())
-				{
-					std::cerr << "File not found: " << url << "\n";
-				}
-				else if (result.isNotAuthorized())
-				{
-					std::cerr << "Access not authorized: " << url << "\n";
-				}
-				else
-				{
-					std::cerr << "No data returned: " << url << "\n";
-				}
-
-				return std::string("");
+				return confirmed_filename;
+			}
+			
+			// report errors
+			if (status == 404)
+			{
+				std::cerr << "File not found: " << url << "\n";
+			}
+			else if (status == 401 || status == 403)
+			{
+				std::cerr << "Access not authorized: " << url << "\n";
 			}
 			else
 			{
-				if (save_to_disk)
-				{
-					// just check for the existence of the file
-					if (file_exists(confirmed_filename))
-						return confirmed_filename;
-				}
-				else
-				{
-					std::string confirmed_filename = filename.size() ? filename : split(url, "/").back();
-					std::fstream file = std::fstream(confirmed_filename, std::fstream::out | std::fstream::binary);
-					if (file.good())
-					{
-						// save file
-						result.save(file);
-
-						file.close();
-						return confirmed_filename;
-					}
-				}
+				std::cerr << "No data returned: " << url << "\n";
 			}
 		}
 
@@ -27,6 +27,8 @@
 
 int main()
 {
+	std::cout << "Connections opened ahead of time:\n\n" << minicurl::prewarm({"http://httpbin.org", "https://httpbin.org"}).warmed << "\n\n";
+	
 	std::cout << "HTTP GET:\n\n" << minicurl::get("http://httpbin.org/get") << "\n\n";
 	
 	std::cout << "HTTP GET with query string:\n\n" << minicurl::get("http://httpbin.org/get?HELLO=WORLD") << "\n\n";
@@ -39,11 +41,35 @@ int main()
 	
 	std::cout << "HTTP POST with stringfied json as payload:\n\n" << minicurl::post("http://httpbin.org/post", "{HELLO:\"WORLD\"}", {"Content-type: application/json"}) << "\n\n";
 	
+	minicurl::package response = minicurl::get_response("http://httpbin.org/get");
+	std::cout << "HTTP GET keeping the whole response (status " << response.status << "):\n\n" << response.content.view() << "\n\n";
+	
+	std::size_t streamed = 0;
+	minicurl::get_stream("http://httpbin.org/bytes/4096", [&streamed](std::string_view block)
+	{
+		streamed += block.size();
+		return minicurl::stream_action::proceed;
+	});
+	std::cout << "Streaming a body block by block (bytes received):\n\n" << streamed << "\n\n";
+	
 	std::cout << "Getting header information:\n\n" << minicurl::get_header("http://httpbin.org/get") << "\n\n";
 	
 	std::cout << "Uploading a file to an address:\n\n" << minicurl::upload("https://httpbin.org/put", "README.md") << "\n\n";
 	
 	std::cout << "Downloading to an optionally specified file (returns filename if succeeded, empty string if failed):\n\n" << minicurl::download("http://httpbin.org/get", "DOWNLOADED.txt") << "\n\n";
 	
+	std::future<minicurl::package> pending = minicurl::get_async("http://httpbin.org/get");
+	std::cout << "HTTP GET driven by the background event thread:\n\n" << pending.get().content.to_string() << "\n\n";
+	
+	std::cout << "Fetching several addresses with bounded concurrency (index, status, error):\n\n";
+	for(minicurl::batch_item const & item : minicurl::get_many({"http://httpbin.org/get", "http://httpbin.org/status/404", "http://invalid.invalid/"}))
+	{
+		std::cout << item.index << ", " << item.response.status << ", " << item.error << "\n";
+	}
+	std::cout << "\n";
+	
+	minicurl::pool_stats pool = minicurl::get_pool_stats();
+	std::cout << "Handle pool (reused / missed / idle):\n\n" << pool.reused << " / " << pool.missed << " / " << pool.idle << "\n\n";
+	
 	return 0;
 }